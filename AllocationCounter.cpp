@@ -0,0 +1,88 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.h"
+
+namespace {
+    std::atomic<uint64_t> allocationCount(0);
+    std::atomic<uint64_t> deallocationCount(0);
+    std::atomic<uint64_t> allocatedBytes(0);
+
+    void* countedAllocate(size_t size) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+        void* memory = std::malloc(size == 0 ? 1 : size);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+
+    void countedFree(void* memory) {
+        if (memory) {
+            deallocationCount.fetch_add(1, std::memory_order_relaxed);
+            std::free(memory);
+        }
+    }
+}
+
+uint64_t AllocationCounter::allocations() {
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocationCounter::deallocations() {
+    return deallocationCount.load(std::memory_order_relaxed);
+}
+
+uint64_t AllocationCounter::bytesAllocated() {
+    return allocatedBytes.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size) {
+    return countedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+    return countedAllocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return countedAllocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return countedAllocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* memory) noexcept {
+    countedFree(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    countedFree(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    countedFree(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    countedFree(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    countedFree(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    countedFree(memory);
+}
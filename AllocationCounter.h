@@ -0,0 +1,15 @@
+#ifndef HM2PP_ALLOCATION_COUNTER_H
+#define HM2PP_ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+// Process-wide heap allocation counters, fed by the replacement operator new/delete in
+// AllocationCounter.cpp. Only targets that link that file get real numbers.
+class AllocationCounter {
+public:
+    static uint64_t allocations();
+    static uint64_t deallocations();
+    static uint64_t bytesAllocated();
+};
+
+#endif //HM2PP_ALLOCATION_COUNTER_H
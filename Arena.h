@@ -0,0 +1,123 @@
+#ifndef HM2PP_ARENA_H
+#define HM2PP_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "MemoryUsage.h"
+
+// Bump allocator that hands out memory from large blocks and frees them all at once.
+// Individual deallocations are no-ops; release() (or destruction) returns every block.
+class Arena {
+private:
+    std::vector<char*> blocks;
+    size_t blockSize;
+    char* current;
+    size_t remaining;
+    size_t used;
+    size_t reserved;
+
+    void addBlock(size_t minSize) {
+        size_t size = minSize > blockSize ? minSize : blockSize;
+        char* block = static_cast<char*>(::operator new(size));
+        blocks.push_back(block);
+        current = block;
+        remaining = size;
+        reserved += size;
+    }
+
+public:
+    explicit Arena(size_t blockSize = 64 * 1024)
+        : blockSize(blockSize), current(nullptr), remaining(0), used(0), reserved(0) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        release();
+    }
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        size_t padding = (alignment - reinterpret_cast<size_t>(current) % alignment) % alignment;
+        if (!current || padding + bytes > remaining) {
+            addBlock(bytes + alignment);
+            padding = (alignment - reinterpret_cast<size_t>(current) % alignment) % alignment;
+        }
+        char* result = current + padding;
+        current += padding + bytes;
+        remaining -= padding + bytes;
+        used += bytes;
+        return result;
+    }
+
+    void release() {
+        for (char* block : blocks) {
+            ::operator delete(block);
+        }
+        blocks.clear();
+        current = nullptr;
+        remaining = 0;
+        used = 0;
+        reserved = 0;
+    }
+
+    size_t bytesUsed() const {
+        return used;
+    }
+
+    size_t bytesReserved() const {
+        return reserved;
+    }
+
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addVector(blocks);
+        if (!blocks.empty()) {
+            usage.live += used;
+            usage.allocated += reserved;
+            usage.overhead += blocks.size() * MemoryUsage::allocatorOverhead(reserved / blocks.size());
+            usage.blocks += blocks.size();
+        }
+        return usage;
+    }
+};
+
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    Arena* arena;
+
+    explicit ArenaAllocator(Arena* arena) noexcept : arena(arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) noexcept {}
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena != b.arena;
+}
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+typedef std::vector<ArenaString, ArenaAllocator<ArenaString>> ArenaLines;
+
+#endif //HM2PP_ARENA_H
@@ -0,0 +1,103 @@
+#ifndef HM2PP_CHROME_TRACE_H
+#define HM2PP_CHROME_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <string>
+
+// Optional writer of Chrome/Perfetto trace-event JSON ("X" complete events), for viewing an
+// editing session in chrome://tracing or ui.perfetto.dev. Disabled unless open() succeeded;
+// while disabled, enabled() is the only cost at each call site.
+class ChromeTrace {
+private:
+    std::ofstream file;
+    std::mutex mutex;
+    std::atomic<bool> active;
+    std::chrono::steady_clock::time_point origin;
+    bool firstEvent;
+
+    ChromeTrace() : active(false), firstEvent(true) {}
+
+    static ChromeTrace& instance() {
+        static ChromeTrace trace;
+        return trace;
+    }
+
+    static void writeEscaped(std::ostream& out, const std::string& text) {
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c)
+                    << std::dec << std::setfill(' ');
+            } else {
+                out << c;
+            }
+        }
+    }
+
+public:
+    static bool open(const std::string& fileName) {
+        ChromeTrace& trace = instance();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        trace.file.open(fileName, std::ios::trunc);
+        if (!trace.file.is_open()) {
+            return false;
+        }
+        trace.origin = std::chrono::steady_clock::now();
+        trace.firstEvent = true;
+        trace.file << "[";
+        trace.active.store(true, std::memory_order_release);
+        return true;
+    }
+
+    static void close() {
+        ChromeTrace& trace = instance();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        if (trace.active.exchange(false)) {
+            trace.file << "\n]\n";
+            trace.file.close();
+        }
+    }
+
+    static bool enabled() {
+        return instance().active.load(std::memory_order_relaxed);
+    }
+
+    // Small sequential id for the calling thread, used as the event "tid".
+    static uint32_t threadId() {
+        static std::atomic<uint32_t> nextId(1);
+        thread_local uint32_t id = nextId.fetch_add(1);
+        return id;
+    }
+
+    // Records a span that started at `start` and ended at `end`; `bytes` is attached as an argument.
+    static void complete(const std::string& name, const char* category,
+                         std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end,
+                         uint64_t bytes = 0) {
+        ChromeTrace& trace = instance();
+        if (!enabled()) {
+            return;
+        }
+        double ts = std::chrono::duration<double, std::micro>(start - trace.origin).count();
+        double dur = std::chrono::duration<double, std::micro>(end - start).count();
+        uint32_t tid = threadId();
+
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        if (!trace.active.load(std::memory_order_relaxed)) {
+            return;
+        }
+        trace.file << (trace.firstEvent ? "\n" : ",\n") << "{\"name\":\"";
+        writeEscaped(trace.file, name);
+        trace.file << "\",\"cat\":\"" << category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+                   << std::fixed << std::setprecision(3) << ",\"ts\":" << ts << ",\"dur\":" << dur
+                   << ",\"args\":{\"bytes\":" << bytes << "}}";
+        trace.firstEvent = false;
+    }
+};
+
+#endif //HM2PP_CHROME_TRACE_H
@@ -0,0 +1,108 @@
+#ifndef HM2PP_CLIPBOARD_RING_H
+#define HM2PP_CLIPBOARD_RING_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MemoryUsage.h"
+#include "TextSlice.h"
+#include "Varint.h"
+
+// Fixed number of clipboard registers, newest first. Every cut or copy pushes a register and
+// the oldest one falls off; registers are text slices, so keeping or pasting them copies
+// nothing until the text lands in a line.
+class ClipboardRing {
+private:
+    std::vector<TextSlice> registers;
+    size_t newest;
+    size_t count;
+
+public:
+    static const size_t kDefaultRegisters = 8;
+
+    explicit ClipboardRing(size_t capacity = kDefaultRegisters)
+        : registers(capacity < 1 ? 1 : capacity), newest(0), count(0) {}
+
+    void push(const TextSlice& text) {
+        newest = (newest + registers.size() - 1) % registers.size();
+        registers[newest] = text;
+        if (count < registers.size()) {
+            count++;
+        }
+    }
+
+    // Register `n` counting from 0 = most recent; an empty slice past the last one filled.
+    const TextSlice& get(size_t n) const {
+        static const TextSlice empty;
+        if (n >= count) {
+            return empty;
+        }
+        return registers[(newest + n) % registers.size()];
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    size_t capacity() const {
+        return registers.size();
+    }
+
+    void clear() {
+        for (TextSlice& text : registers) {
+            text = TextSlice();
+        }
+        count = 0;
+    }
+
+    // Serialized as a varint register count, then each register newest first as a varint
+    // length and its bytes.
+    void encode(std::string& out) const {
+        appendVarint(out, count);
+        for (size_t i = 0; i < count; i++) {
+            const TextSlice& text = get(i);
+            appendVarint(out, text.size());
+            out.append(text.data(), text.size());
+        }
+    }
+
+    // Replaces the registers with an encoded ring; returns false (leaving them unchanged) if the
+    // data is not one.
+    bool decode(const char* data, size_t size) {
+        const char* cursor = data;
+        const char* end = data + size;
+        uint64_t stored;
+        if (!readVarint(cursor, end, stored) || stored > registers.size()) {
+            return false;
+        }
+        std::vector<TextSlice> texts;
+        for (uint64_t i = 0; i < stored; i++) {
+            uint64_t length;
+            if (!readVarint(cursor, end, length) || length > static_cast<uint64_t>(end - cursor)) {
+                return false;
+            }
+            texts.push_back(TextSlice::copy(cursor, static_cast<size_t>(length)));
+            cursor += length;
+        }
+        if (cursor != end) {
+            return false;
+        }
+        clear();
+        for (size_t i = texts.size(); i > 0; i--) {
+            push(texts[i - 1]);
+        }
+        return true;
+    }
+
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addVector(registers);
+        for (size_t i = 0; i < count; i++) {
+            usage += get(i).memoryUsage();
+        }
+        return usage;
+    }
+};
+
+#endif //HM2PP_CLIPBOARD_RING_H
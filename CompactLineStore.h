@@ -0,0 +1,278 @@
+#ifndef HM2PP_COMPACT_LINE_STORE_H
+#define HM2PP_COMPACT_LINE_STORE_H
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "LineView.h"
+#include "MemoryUsage.h"
+#include "TextSlice.h"
+
+// Structure-of-arrays store for documents made of many short lines. All text lives in one
+// contiguous buffer addressed by a per-line offset/length pair (12 bytes per line instead of a
+// 32-byte std::string plus its heap block), so scans walk memory sequentially. A line that gets
+// edited moves to a side buffer of ordinary strings; compact() folds those back in.
+class CompactLineStore {
+private:
+    static const uint64_t kEditedFlag = uint64_t(1) << 63;
+
+    std::vector<char> chars;
+    std::vector<uint64_t> offsets;
+    std::vector<uint32_t> lengths;
+    std::vector<std::string> edited;
+    std::vector<size_t> freeEdited;
+    size_t deadBytes;
+
+    static uint32_t checkedLength(size_t length) {
+        if (length > std::numeric_limits<uint32_t>::max()) {
+            throw std::length_error("Line is too long for CompactLineStore.");
+        }
+        return static_cast<uint32_t>(length);
+    }
+
+    bool isEdited(size_t index) const {
+        return (offsets[index] & kEditedFlag) != 0;
+    }
+
+    void maybeCompact() {
+        if (deadBytes > 64 * 1024 && deadBytes > chars.size() / 2) {
+            compact();
+        }
+    }
+
+public:
+    struct Snapshot {
+        std::vector<char> chars;
+        std::vector<uint64_t> offsets;
+        std::vector<uint32_t> lengths;
+
+        size_t size() const {
+            return offsets.size();
+        }
+
+        LineView line(size_t index) const {
+            if (lengths[index] == 0) {
+                return LineView();
+            }
+            return LineView(chars.data() + offsets[index], lengths[index]);
+        }
+
+        uint64_t textBytes() const {
+            return chars.size();
+        }
+
+        MemoryUsage memoryUsage() const {
+            MemoryUsage usage;
+            usage.addVector(chars);
+            usage.addVector(offsets);
+            usage.addVector(lengths);
+            return usage;
+        }
+    };
+
+    CompactLineStore() : deadBytes(0) {}
+
+    size_t size() const {
+        return offsets.size();
+    }
+
+    LineView line(size_t index) const {
+        if (isEdited(index)) {
+            return edited[offsets[index] & ~kEditedFlag];
+        }
+        if (lengths[index] == 0) {
+            return LineView();
+        }
+        return LineView(chars.data() + offsets[index], lengths[index]);
+    }
+
+    template <typename Edit>
+    void modify(size_t index, Edit edit) {
+        if (isEdited(index)) {
+            std::string& line = edited[offsets[index] & ~kEditedFlag];
+            edit(line);
+            lengths[index] = checkedLength(line.size());
+            return;
+        }
+
+        size_t offset = offsets[index];
+        std::string line(chars.data() + offset, lengths[index]);
+        edit(line);
+
+        if (lengths[index] != 0 && offset + lengths[index] == chars.size()) {
+            // The last bytes of the buffer belong to this line, so it can be rewritten in place.
+            chars.resize(offset);
+            chars.insert(chars.end(), line.begin(), line.end());
+            lengths[index] = checkedLength(line.size());
+            return;
+        }
+
+        deadBytes += lengths[index];
+        size_t slot;
+        if (!freeEdited.empty()) {
+            slot = freeEdited.back();
+            freeEdited.pop_back();
+            edited[slot] = std::move(line);
+        } else {
+            slot = edited.size();
+            edited.push_back(std::move(line));
+        }
+        offsets[index] = kEditedFlag | slot;
+        lengths[index] = checkedLength(edited[slot].size());
+        maybeCompact();
+    }
+
+    // The buffer moves when it grows or is compacted, so the slice is a private copy.
+    TextSlice share(size_t index, size_t position, size_t length) const {
+        return TextSlice::copy(line(index).data + position, length);
+    }
+
+    void push_back(const char* data, size_t size) {
+        offsets.push_back(chars.size());
+        lengths.push_back(checkedLength(size));
+        chars.insert(chars.end(), data, data + size);
+    }
+
+    void push_back(const std::string& line) {
+        push_back(line.data(), line.size());
+    }
+
+    // Replaces lines [first, first + count) with `n` new ones appended to the buffer; the old
+    // lines become dead bytes. `data` must not point into the store.
+    void splice(size_t first, size_t count, const LineView* data, size_t n) {
+        for (size_t i = first; i < first + count; i++) {
+            if (isEdited(i)) {
+                size_t slot = offsets[i] & ~kEditedFlag;
+                std::string().swap(edited[slot]);
+                freeEdited.push_back(slot);
+            } else {
+                deadBytes += lengths[i];
+            }
+        }
+        std::vector<uint64_t> newOffsets;
+        std::vector<uint32_t> newLengths;
+        newOffsets.reserve(n);
+        newLengths.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            newOffsets.push_back(chars.size());
+            newLengths.push_back(checkedLength(data[i].size));
+            chars.insert(chars.end(), data[i].data, data[i].data + data[i].size);
+        }
+        offsets.erase(offsets.begin() + first, offsets.begin() + first + count);
+        offsets.insert(offsets.begin() + first, newOffsets.begin(), newOffsets.end());
+        lengths.erase(lengths.begin() + first, lengths.begin() + first + count);
+        lengths.insert(lengths.begin() + first, newLengths.begin(), newLengths.end());
+        maybeCompact();
+    }
+
+    void assign(const std::vector<std::string>& data) {
+        size_t total = 0;
+        for (const std::string& line : data) {
+            total += line.size();
+        }
+        chars.clear();
+        offsets.clear();
+        lengths.clear();
+        edited.clear();
+        freeEdited.clear();
+        deadBytes = 0;
+        chars.reserve(total);
+        offsets.reserve(data.size());
+        lengths.reserve(data.size());
+        for (const std::string& line : data) {
+            push_back(line);
+        }
+    }
+
+    void assign(const LineView* data, size_t count) {
+        size_t total = 0;
+        for (size_t i = 0; i < count; i++) {
+            total += data[i].size;
+        }
+        chars.clear();
+        offsets.clear();
+        lengths.clear();
+        edited.clear();
+        freeEdited.clear();
+        deadBytes = 0;
+        chars.reserve(total);
+        offsets.reserve(count);
+        lengths.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            push_back(data[i].data, data[i].size);
+        }
+    }
+
+    std::vector<std::string> toVector() const {
+        std::vector<std::string> result;
+        result.reserve(size());
+        for (size_t i = 0; i < size(); i++) {
+            result.push_back(line(i).str());
+        }
+        return result;
+    }
+
+    // Copies the lines out and empties the store; its text is not kept as std::strings.
+    std::vector<std::string> release() {
+        std::vector<std::string> result = toVector();
+        assign(std::vector<std::string>());
+        return result;
+    }
+
+    // Rewrites the buffer so every line is contiguous again and the side buffer is empty.
+    void compact() {
+        Snapshot packed = snapshot();
+        restore(packed);
+    }
+
+    Snapshot snapshot() const {
+        Snapshot result;
+        if (edited.size() == freeEdited.size() && deadBytes == 0) {
+            result.chars = chars;
+            result.offsets = offsets;
+            result.lengths = lengths;
+            return result;
+        }
+
+        size_t total = 0;
+        for (uint32_t length : lengths) {
+            total += length;
+        }
+        result.chars.reserve(total);
+        result.offsets.reserve(size());
+        result.lengths = lengths;
+        for (size_t i = 0; i < size(); i++) {
+            LineView text = line(i);
+            result.offsets.push_back(result.chars.size());
+            result.chars.insert(result.chars.end(), text.data, text.data + text.size);
+        }
+        return result;
+    }
+
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addVector(chars);
+        usage.addVector(offsets);
+        usage.addVector(lengths);
+        usage.addVector(edited);
+        usage.addVector(freeEdited);
+        for (const std::string& line : edited) {
+            usage.addString(line);
+        }
+        return usage;
+    }
+
+    void restore(const Snapshot& snapshot) {
+        chars = snapshot.chars;
+        offsets = snapshot.offsets;
+        lengths = snapshot.lengths;
+        edited.clear();
+        freeEdited.clear();
+        deadBytes = 0;
+    }
+};
+
+#endif //HM2PP_COMPACT_LINE_STORE_H
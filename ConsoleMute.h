@@ -0,0 +1,37 @@
+#ifndef HM2PP_CONSOLE_MUTE_H
+#define HM2PP_CONSOLE_MUTE_H
+
+#include <iostream>
+#include <streambuf>
+
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        return count;
+    }
+};
+
+// Silences std::cout/std::cerr for its lifetime, for timing operations that report to the console.
+class ConsoleMute {
+private:
+    NullBuffer sink;
+    std::streambuf* savedOut;
+    std::streambuf* savedErr;
+
+public:
+    ConsoleMute() : savedOut(std::cout.rdbuf(&sink)), savedErr(std::cerr.rdbuf(&sink)) {}
+
+    ConsoleMute(const ConsoleMute&) = delete;
+    ConsoleMute& operator=(const ConsoleMute&) = delete;
+
+    ~ConsoleMute() {
+        std::cout.rdbuf(savedOut);
+        std::cerr.rdbuf(savedErr);
+    }
+};
+
+#endif //HM2PP_CONSOLE_MUTE_H
@@ -0,0 +1,574 @@
+#ifndef HM2PP_EDIT_JOURNAL_H
+#define HM2PP_EDIT_JOURNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "ChromeTrace.h"
+#include "EditTrace.h"
+#include "EditorCommands.h"
+#include "FilesSL.h"
+#include "Hashing.h"
+#include "StringArray.h"
+
+// Write-ahead journal of edit commands, kept next to the document as "<file>.journal".
+// Appends only copy the record into a memory buffer; a background thread writes and fsyncs
+// whatever accumulated every `commitInterval` (group commit), so a crash loses at most that
+// window. After a crash, loading the file offers to replay the journal on top of it. Saving
+// the document empties the journal again; quitting or replacing the document by another load
+// or a restored session removes it, since those give up the unsaved edits.
+//
+// Every journal starts with a checkpoint record: the state the commands after it start from.
+// Undo, redo and goto are journaled as a goto of the version they reached, and edits that add
+// versions to the undo history are followed by a record naming them (see kVersion). A
+// recovering process numbers its versions differently, and has more of them since it replays
+// without coalescing, so it maps the recorded ids onto its own versions as it replays. Only a
+// move to a version from before the checkpoint, which the records cannot rebuild, restarts the
+// journal from a checkpoint holding the document.
+//
+// The header holds the settings of the session that wrote the journal (see SessionSettings):
+// positions in the records count bytes or codepoints according to them.
+//
+// Record layout: varint payload length, encoded EditCommand, 4-byte checksum of the payload.
+// A torn record at the tail (crash mid-write) fails its checksum and is dropped on recovery.
+class EditJournal {
+private:
+    std::mutex fileMutex;
+    std::mutex bufferMutex;
+    std::condition_variable wake;
+    std::string pending;
+    // `pending` starts with a checkpoint that replaces the journal rather than extending it.
+    bool restartPending;
+    std::FILE* file;
+    std::string journalPath;
+    std::string documentPath;
+    SessionSettings sessionSettings;
+    std::chrono::milliseconds commitInterval;
+    size_t commitBytes;
+    bool stopping;
+    std::thread flusher;
+    // Versions of the undo history the records since the checkpoint can rebuild, and where the
+    // history stood after the last journaled command. Used by the editing thread only.
+    std::unordered_set<size_t> replayable;
+    size_t lastVersion;
+    size_t lastNextVersion;
+    bool lastDetached;
+
+    static const char* magic() {
+        return "HM2PPJ4\n";
+    }
+
+    static void encodeRecord(std::string& out, const EditCommand& request) {
+        std::string payload;
+        encodeCommand(payload, request);
+        uint32_t checksum = static_cast<uint32_t>(hashBytes(payload.data(), payload.size()));
+        appendVarint(out, payload.size());
+        out.append(payload);
+        out.append(reinterpret_cast<const char*>(&checksum), 4);
+    }
+
+    static void syncFile(std::FILE* target) {
+        std::fflush(target);
+#if defined(_WIN32)
+        _commit(_fileno(target));
+#else
+        fsync(fileno(target));
+#endif
+    }
+
+    // Writes out everything appended so far. Called by the flusher thread and before the journal
+    // is switched, reset or closed.
+    void commit() {
+        std::lock_guard<std::mutex> fileLock(fileMutex);
+        std::string batch;
+        bool restart;
+        {
+            std::lock_guard<std::mutex> bufferLock(bufferMutex);
+            batch.swap(pending);
+            restart = restartPending;
+            restartPending = false;
+        }
+        if (batch.empty() || !file) {
+            return;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (restart) {
+            replaceFile(batch);
+        } else {
+            std::fwrite(batch.data(), 1, batch.size(), file);
+            syncFile(file);
+        }
+        if (ChromeTrace::enabled()) {
+            ChromeTrace::complete("EditJournal::commit", "journal", start, std::chrono::steady_clock::now(),
+                                  batch.size());
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(bufferMutex);
+        while (!stopping) {
+            wake.wait_for(lock, commitInterval, [this] { return stopping || pending.size() >= commitBytes; });
+            lock.unlock();
+            commit();
+            lock.lock();
+        }
+    }
+
+    void closeFile() {
+        if (file) {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+    // Opens `path` as a new journal holding `records`.
+    bool openFresh(const std::string& path, const std::string& records) {
+        file = std::fopen(path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        std::string header(magic(), 8);
+        encodeSettings(header, sessionSettings);
+        std::fwrite(header.data(), 1, header.size(), file);
+        std::fwrite(records.data(), 1, records.size(), file);
+        syncFile(file);
+        return true;
+    }
+
+    // Replaces the open journal with one holding only `records`. The new journal is written
+    // beside it and renamed over it, so a crash leaves one of the two intact.
+    void replaceFile(const std::string& records) {
+        std::string replacement = journalPath + ".new";
+        closeFile();
+        if (!openFresh(replacement, records)) {
+            openFresh(journalPath, records);
+            return;
+        }
+        closeFile();
+#if defined(_WIN32)
+        std::remove(journalPath.c_str());
+#endif
+        if (std::rename(replacement.c_str(), journalPath.c_str()) != 0) {
+            std::remove(replacement.c_str());
+            openFresh(journalPath, records);
+            return;
+        }
+        file = std::fopen(journalPath.c_str(), "ab");
+    }
+
+    // The journal starts over from the checkpoint `start`.
+    void trackVersions(const EditCommand& start) {
+        replayable.clear();
+        lastVersion = checkpointVersion(start);
+        lastDetached = !checkpointIsVersion(start);
+        lastNextVersion = start.numbers.size() > 3 ? static_cast<size_t>(start.numbers[3]) : 0;
+        if (!lastDetached) {
+            replayable.insert(lastVersion);
+        }
+    }
+
+    void appendVersion(std::vector<int64_t> numbers) {
+        EditCommand record(kVersion);
+        record.numbers = numbers;
+        for (int64_t version : numbers) {
+            replayable.insert(static_cast<size_t>(version));
+        }
+        append(record);
+    }
+
+public:
+    // `settings` are those of the session whose edits are journaled.
+    explicit EditJournal(const SessionSettings& settings = SessionSettings(),
+                         std::chrono::milliseconds commitInterval = std::chrono::milliseconds(20),
+                         size_t commitBytes = 64 * 1024)
+        : restartPending(false), file(nullptr), sessionSettings(settings), commitInterval(commitInterval),
+          commitBytes(commitBytes), stopping(false), lastVersion(0), lastNextVersion(0), lastDetached(true) {
+        flusher = std::thread(&EditJournal::run, this);
+    }
+
+    EditJournal(const EditJournal&) = delete;
+    EditJournal& operator=(const EditJournal&) = delete;
+
+    ~EditJournal() {
+        {
+            std::lock_guard<std::mutex> lock(bufferMutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        flusher.join();
+        commit();
+        closeFile();
+    }
+
+    // Command number of checkpoint records. The text is the state the following commands start
+    // from (see BasicStringArray::writeCheckpoint). The numbers are 1 when that state includes
+    // the document and 0 when the document is the file as it was loaded or saved; the current
+    // version of the undo history; 1 when the document is that version rather than detached from
+    // it; and the id the next version gets.
+    static const int kCheckpoint = 0;
+
+    // Command number, used by no editor command, of records naming the version of the undo
+    // history the document is after the command before them, and, when there is a second
+    // number, the version it was made from. Moves journaled as goto (command 33) carry the
+    // version they reached and the one they left.
+    static const int kVersion = 100;
+
+    static std::string pathFor(const std::string& fileName) {
+        return fileName + ".journal";
+    }
+
+    static bool isCheckpoint(const EditCommand& record) {
+        return record.command == kCheckpoint;
+    }
+
+    static bool checkpointHasDocument(const EditCommand& record) {
+        return isCheckpoint(record) && !record.numbers.empty() && record.numbers[0] != 0;
+    }
+
+    static size_t checkpointVersion(const EditCommand& record) {
+        return record.numbers.size() > 1 ? static_cast<size_t>(record.numbers[1]) : 0;
+    }
+
+    // Whether the checkpoint's document is its version rather than detached from it.
+    static bool checkpointIsVersion(const EditCommand& record) {
+        return record.numbers.size() > 2 && record.numbers[2] != 0;
+    }
+
+    static bool isVersion(const EditCommand& record) {
+        return record.command == kVersion;
+    }
+
+    // Reads the settings and intact records of a journal; `validBytes` is where the first damaged
+    // record starts. A journal that does not start with a checkpoint has no records.
+    static std::vector<EditCommand> readRecords(const std::string& path, uint64_t& validBytes,
+                                                SessionSettings& settings) {
+        std::vector<EditCommand> records;
+        validBytes = 0;
+        std::ifstream in(path, std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (contents.size() < 8 || contents.compare(0, 8, magic()) != 0) {
+            return records;
+        }
+        const char* cursor = contents.data() + 8;
+        const char* end = contents.data() + contents.size();
+        if (!decodeSettings(cursor, end, settings)) {
+            return records;
+        }
+        while (cursor != end) {
+            uint64_t length;
+            if (!readVarint(cursor, end, length) || static_cast<uint64_t>(end - cursor) < length + 4) {
+                break;
+            }
+            const char* payload = cursor;
+            uint32_t stored;
+            std::memcpy(&stored, payload + length, 4);
+            if (stored != static_cast<uint32_t>(hashBytes(payload, length))) {
+                break;
+            }
+            EditCommand request;
+            const char* decoded = payload;
+            if (!decodeCommand(decoded, payload + length, request) || decoded != payload + length) {
+                break;
+            }
+            if (records.empty() && !isCheckpoint(request)) {
+                break;
+            }
+            records.push_back(request);
+            cursor = payload + length + 4;
+            validBytes = cursor - contents.data();
+        }
+        if (records.empty()) {
+            validBytes = 0;
+        }
+        return records;
+    }
+
+    // Whether recovered records change anything: they hold a command or a document.
+    static bool hasEdits(const std::vector<EditCommand>& records) {
+        return records.size() > 1 || (records.size() == 1 && checkpointHasDocument(records[0]));
+    }
+
+    // Starts journaling edits of `fileName`, which has just been loaded in the state `start`
+    // (a checkpoint), and removes the journal of the document the load replaced. Returns what a
+    // crashed session left in the new journal (see hasEdits), with the settings it ran with in
+    // `recoveredSettings`. The caller either replays it on top of the loaded file (see
+    // recoverJournal), and new records are appended after it, or restarts the journal.
+    std::vector<EditCommand> attach(const std::string& fileName, const EditCommand& start,
+                                    SessionSettings& recoveredSettings) {
+        discard();
+        std::lock_guard<std::mutex> fileLock(fileMutex);
+        documentPath = fileName;
+        journalPath = pathFor(fileName);
+
+        uint64_t validBytes;
+        std::vector<EditCommand> recovered = readRecords(journalPath, validBytes, recoveredSettings);
+        if (hasEdits(recovered)) {
+            FilesSL::truncateFile(journalPath, validBytes);
+            file = std::fopen(journalPath.c_str(), "ab");
+            return recovered;
+        }
+        std::string records;
+        encodeRecord(records, start);
+        openFresh(journalPath, records);
+        trackVersions(start);
+        return std::vector<EditCommand>();
+    }
+
+    // The document was saved to `fileName` in the state `start`: its journal restarts from there.
+    // When saved under a new name, the previous journal is removed because the saved file now
+    // holds its edits.
+    void saved(const std::string& fileName, const EditCommand& start) {
+        commit();
+        std::lock_guard<std::mutex> fileLock(fileMutex);
+        closeFile();
+        if (!journalPath.empty() && fileName != documentPath) {
+            std::remove(journalPath.c_str());
+        }
+        documentPath = fileName;
+        journalPath = pathFor(fileName);
+        std::string records;
+        encodeRecord(records, start);
+        openFresh(journalPath, records);
+        trackVersions(start);
+    }
+
+    // Drops everything journaled so far: the journal continues from the checkpoint `start`.
+    // Written by the background thread like appends.
+    void restart(const EditCommand& start) {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        pending.clear();
+        encodeRecord(pending, start);
+        restartPending = true;
+        wake.notify_one();
+        trackVersions(start);
+    }
+
+    // Stops journaling and keeps the journal on disk, for the next time the file is loaded.
+    void detach() {
+        commit();
+        std::lock_guard<std::mutex> fileLock(fileMutex);
+        closeFile();
+        documentPath.clear();
+        journalPath.clear();
+    }
+
+    // Stops journaling and removes the journal, giving up the edits in it: the editor is
+    // quitting, or the document was replaced by a failed load or a restored session.
+    void discard() {
+        std::lock_guard<std::mutex> fileLock(fileMutex);
+        {
+            std::lock_guard<std::mutex> bufferLock(bufferMutex);
+            pending.clear();
+            restartPending = false;
+        }
+        closeFile();
+        if (!journalPath.empty()) {
+            std::remove(journalPath.c_str());
+        }
+        documentPath.clear();
+        journalPath.clear();
+    }
+
+    const SessionSettings& settings() const {
+        return sessionSettings;
+    }
+
+    bool isAttached() const {
+        return !journalPath.empty();
+    }
+
+    const std::string& path() const {
+        return journalPath;
+    }
+
+    void append(const EditCommand& request) {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        encodeRecord(pending, request);
+        if (pending.size() >= commitBytes) {
+            wake.notify_one();
+        }
+    }
+
+    // Commands that change the document, the clipboard or the open transaction, and so must be
+    // replayed on recovery.
+    static bool isJournaled(int command) {
+        switch (command) {
+            case 1:
+            case 2:
+            case 7:
+            case 8:
+            case 11:
+            case 12:
+            case 13:
+            case 23:
+            case 25:
+            case 26:
+            case 27:
+            case 28:
+            case 29:
+            case 30:
+            case 31:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Undo, redo and goto: journaled through moved() rather than as they were given, since their
+    // effect depends on the undo history.
+    static bool movesThroughHistory(int command) {
+        return command == 9 || command == 10 || command == 33;
+    }
+
+    // Follows a journaled edit that has just run with a version record when it added versions to
+    // the undo history or detached the document from its version: the version it left then has
+    // its final content, which a later move may go back to.
+    template <typename Store>
+    void edited(const BasicStringArray<Store>& stringArray) {
+        size_t version = stringArray.currentVersion();
+        size_t nextVersion = stringArray.nextVersionId();
+        if (nextVersion != lastNextVersion) {
+            size_t parent = stringArray.parentVersion(version);
+            // A version added only to keep a detached document was not made from its parent.
+            if ((lastDetached && version == lastNextVersion) || parent == UndoTree<Store>::kNoVersion) {
+                appendVersion({static_cast<int64_t>(version)});
+            } else {
+                appendVersion({static_cast<int64_t>(version), static_cast<int64_t>(parent)});
+            }
+        } else if (stringArray.isDetached() && !lastDetached) {
+            appendVersion({static_cast<int64_t>(version)});
+        }
+        lastVersion = version;
+        lastNextVersion = nextVersion;
+        lastDetached = stringArray.isDetached();
+    }
+
+    // Journals an undo, redo or goto that has just run as a goto of the version it reached, which
+    // also names the version it left (a detached document becomes one when moving). Returns false
+    // when the records cannot rebuild the version reached: the journal has to restart from it.
+    template <typename Store>
+    bool moved(const BasicStringArray<Store>& stringArray) {
+        size_t version = stringArray.currentVersion();
+        size_t nextVersion = stringArray.nextVersionId();
+        if (version == lastVersion && nextVersion == lastNextVersion) {
+            return true;
+        }
+        if (replayable.count(version) == 0) {
+            return false;
+        }
+        size_t left = lastDetached ? lastNextVersion : lastVersion;
+        EditCommand record(33);
+        record.numbers = {static_cast<int64_t>(version), static_cast<int64_t>(left)};
+        replayable.insert(left);
+        append(record);
+        lastVersion = version;
+        lastNextVersion = nextVersion;
+        lastDetached = false;
+        return true;
+    }
+};
+
+// Checkpoint record of the document's clipboard registers and, with `withDocument`, its lines,
+// and of where its undo history stands.
+template <typename Store>
+EditCommand journalCheckpoint(const BasicStringArray<Store>& stringArray, bool withDocument) {
+    EditCommand record(EditJournal::kCheckpoint);
+    stringArray.writeCheckpoint(record.text, withDocument);
+    record.numbers = {withDocument ? 1 : 0, static_cast<int64_t>(stringArray.currentVersion()),
+                      stringArray.isDetached() ? 0 : 1, static_cast<int64_t>(stringArray.nextVersionId())};
+    return record;
+}
+
+// Replays what attach() recovered on top of the freshly loaded file. The records run under the
+// settings they were written with, except that coalescing is off: the journal does not keep
+// the time between edits, and replaying at full speed would merge edits that were not merged.
+// The history limit waits until the end too, since the replay adds more versions than the
+// session did. The journal's own settings apply again afterwards, and the journal restarts from
+// the recovered document: its records name versions of the crashed session and may count
+// columns differently.
+template <typename Store>
+void recoverJournal(EditJournal& journal, BasicStringArray<Store>& stringArray,
+                    const std::vector<EditCommand>& records, const SessionSettings& recoveredSettings) {
+    if (records.empty()) {
+        return;
+    }
+    SessionSettings replaySettings = recoveredSettings;
+    replaySettings.coalesceGap = std::chrono::milliseconds(0);
+    replaySettings.historyLimit = 0;
+    applySettings(stringArray, replaySettings);
+    // The version of this document's history that holds each recorded version.
+    std::unordered_map<size_t, size_t> versions;
+    for (const EditCommand& record : records) {
+        if (EditJournal::isCheckpoint(record)) {
+            versions.clear();
+            if (!stringArray.readCheckpoint(record.text.data(), record.text.size())) {
+                std::cerr << "Invalid journal checkpoint." << std::endl;
+            } else if (EditJournal::checkpointIsVersion(record)) {
+                versions[EditJournal::checkpointVersion(record)] = stringArray.versionOfDocument();
+            }
+        } else if (EditJournal::isVersion(record)) {
+            size_t version = stringArray.currentVersion();
+            for (int64_t recorded : record.numbers) {
+                versions[static_cast<size_t>(recorded)] = version;
+                version = stringArray.parentVersion(version);
+            }
+        } else if (record.command == 33 && record.numbers.size() == 2) {
+            versions[static_cast<size_t>(record.numbers[1])] = stringArray.versionOfDocument();
+            std::unordered_map<size_t, size_t>::const_iterator target =
+                versions.find(static_cast<size_t>(record.numbers[0]));
+            if (target == versions.end() || !stringArray.gotoVersion(target->second)) {
+                std::cerr << "Invalid journal version." << std::endl;
+            }
+        } else {
+            executeCommand(stringArray, record);
+        }
+    }
+    applySettings(stringArray, journal.settings());
+    journal.restart(journalCheckpoint(stringArray, true));
+}
+
+// Keeps the journal in step with a command that has just run, other than a load (the caller
+// attaches the journal then): saves restart it, restored sessions discard it, and edits and
+// moves through the undo history are appended.
+template <typename Store>
+void journalCommand(EditJournal& journal, const BasicStringArray<Store>& stringArray, const EditCommand& request,
+                    bool ok) {
+    if (request.command == 4) {
+        if (ok) {
+            journal.saved(request.text, journalCheckpoint(stringArray, false));
+        }
+    } else if (request.command == 22) {
+        if (ok) {
+            journal.discard();
+        }
+    } else if (!journal.isAttached()) {
+        return;
+    } else if (EditJournal::movesThroughHistory(request.command)) {
+        // Refused while a transaction is open, so then there is nothing to record.
+        if (!stringArray.inTransaction() && !journal.moved(stringArray)) {
+            journal.restart(journalCheckpoint(stringArray, true));
+        }
+    } else if (EditJournal::isJournaled(request.command)) {
+        journal.append(request);
+        journal.edited(stringArray);
+    }
+}
+
+#endif //HM2PP_EDIT_JOURNAL_H
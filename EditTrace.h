@@ -0,0 +1,174 @@
+#ifndef HM2PP_EDIT_TRACE_H
+#define HM2PP_EDIT_TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "Varint.h"
+
+// One editor command with its arguments, as entered at the main loop prompt.
+struct EditCommand {
+    int command;
+    std::vector<int64_t> numbers;
+    std::string text;
+
+    explicit EditCommand(int command = 0) : command(command) {}
+};
+
+// Command, zigzag-encoded numbers and text, each length-prefixed with a varint.
+inline void encodeCommand(std::string& out, const EditCommand& request) {
+    appendVarint(out, static_cast<uint64_t>(request.command));
+    appendVarint(out, request.numbers.size());
+    for (int64_t number : request.numbers) {
+        appendVarint(out, (static_cast<uint64_t>(number) << 1) ^ static_cast<uint64_t>(number >> 63));
+    }
+    appendVarint(out, request.text.size());
+    out.append(request.text);
+}
+
+inline bool decodeCommand(const char*& cursor, const char* end, EditCommand& request) {
+    uint64_t command, count, length;
+    if (!readVarint(cursor, end, command) || !readVarint(cursor, end, count)) {
+        return false;
+    }
+    request = EditCommand(static_cast<int>(command));
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t encoded;
+        if (!readVarint(cursor, end, encoded)) {
+            return false;
+        }
+        request.numbers.push_back(static_cast<int64_t>((encoded >> 1) ^ (~(encoded & 1) + 1)));
+    }
+    if (!readVarint(cursor, end, length) || static_cast<uint64_t>(end - cursor) < length) {
+        return false;
+    }
+    request.text.assign(cursor, length);
+    cursor += length;
+    return true;
+}
+
+// Session flags that change what commands do: the coalescing gap (--coalesce-ms), the undo
+// history limit (--history-limit) and codepoint columns (--columns). Traces and journals
+// record them so that a replay runs the commands the way the recorded session did.
+struct SessionSettings {
+    std::chrono::milliseconds coalesceGap;
+    size_t historyLimit;
+    bool codepointColumns;
+
+    SessionSettings() : coalesceGap(0), historyLimit(0), codepointColumns(false) {}
+};
+
+// Coalescing gap in milliseconds, history limit, then flags (bit 0: codepoint columns), as varints.
+inline void encodeSettings(std::string& out, const SessionSettings& settings) {
+    appendVarint(out, static_cast<uint64_t>(settings.coalesceGap.count()));
+    appendVarint(out, settings.historyLimit);
+    appendVarint(out, settings.codepointColumns ? 1 : 0);
+}
+
+inline bool decodeSettings(const char*& cursor, const char* end, SessionSettings& settings) {
+    uint64_t gap, limit, flags;
+    if (!readVarint(cursor, end, gap) || !readVarint(cursor, end, limit) || !readVarint(cursor, end, flags)) {
+        return false;
+    }
+    settings.coalesceGap = std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(gap));
+    settings.historyLimit = static_cast<size_t>(limit);
+    settings.codepointColumns = (flags & 1) != 0;
+    return true;
+}
+
+struct TraceRecord {
+    EditCommand request;
+    uint64_t startNs;
+    uint64_t durationNs;
+};
+
+// Compact binary trace of an editing session: a magic header and the session settings,
+// followed by one record per command (start delta and duration as varints, then the encoded
+// command). Version 1 traces have no settings and replay with the defaults.
+class TraceWriter {
+private:
+    std::ofstream file;
+    uint64_t lastStartNs;
+    std::string record;
+
+public:
+    static const char* magic() {
+        return "HM2PPTR2";
+    }
+
+    static const char* legacyMagic() {
+        return "HM2PPTR1";
+    }
+
+    TraceWriter(const std::string& fileName, const SessionSettings& settings)
+        : file(fileName, std::ios::binary | std::ios::trunc), lastStartNs(0) {
+        record.assign(magic(), 8);
+        encodeSettings(record, settings);
+        file.write(record.data(), record.size());
+    }
+
+    bool isOpen() const {
+        return file.is_open();
+    }
+
+    void write(const EditCommand& request, uint64_t startNs, uint64_t durationNs) {
+        record.clear();
+        appendVarint(record, startNs - lastStartNs);
+        appendVarint(record, durationNs);
+        encodeCommand(record, request);
+        file.write(record.data(), record.size());
+        file.flush();
+        lastStartNs = startNs;
+    }
+};
+
+class TraceReader {
+private:
+    std::string contents;
+    const char* cursor;
+    uint64_t lastStartNs;
+    SessionSettings recordedSettings;
+    bool valid;
+
+public:
+    explicit TraceReader(const std::string& fileName) : cursor(nullptr), lastStartNs(0), valid(false) {
+        std::ifstream file(fileName, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        if (contents.size() < 8) {
+            return;
+        }
+        cursor = contents.data() + 8;
+        if (contents.compare(0, 8, TraceWriter::magic()) == 0) {
+            valid = decodeSettings(cursor, contents.data() + contents.size(), recordedSettings);
+        } else {
+            valid = contents.compare(0, 8, TraceWriter::legacyMagic()) == 0;
+        }
+    }
+
+    bool isValid() const {
+        return valid;
+    }
+
+    // The settings of the recorded session.
+    const SessionSettings& settings() const {
+        return recordedSettings;
+    }
+
+    bool next(TraceRecord& record) {
+        const char* end = contents.data() + contents.size();
+        uint64_t delta;
+        if (!valid || !readVarint(cursor, end, delta) || !readVarint(cursor, end, record.durationNs) ||
+            !decodeCommand(cursor, end, record.request)) {
+            return false;
+        }
+        lastStartNs += delta;
+        record.startNs = lastStartNs;
+        return true;
+    }
+};
+
+#endif //HM2PP_EDIT_TRACE_H
@@ -0,0 +1,235 @@
+#ifndef HM2PP_EDITOR_COMMANDS_H
+#define HM2PP_EDITOR_COMMANDS_H
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "EditTrace.h"
+#include "OperationStats.h"
+#include "SearchFunctions.h"
+#include "StringArray.h"
+
+inline const char* commandName(int command) {
+    static const char* names[] = {
+        "none", "append", "emptyline", "print", "save", "load", "search", "insert", "delete", "undo", "redo",
+        "cut", "copy", "paste", "offset2pos", "pos2offset", "printrange", "viewport", "stats", "statsjson", "memory",
+        "savesession", "loadsession", "pasteregister", "clipboard", "cutrange",
+        "copyrange", "deleterange", "begin", "commit", "rollback",
+        "insertlines", "versions", "goto", "difffile", "diffversion"
+    };
+    if (command < 0 || command >= static_cast<int>(sizeof(names) / sizeof(names[0]))) {
+        return "unknown";
+    }
+    return names[command];
+}
+
+// Number of integer arguments each command reads from the prompt.
+inline size_t commandArgumentCount(int command) {
+    switch (command) {
+        case 7:
+        case 8:
+        case 11:
+        case 12:
+        case 23:
+            return 3;
+        case 25:
+        case 26:
+        case 27:
+            return 4;
+        case 13:
+        case 15:
+        case 16:
+        case 17:
+        case 35:
+            return 2;
+        case 14:
+        case 31:
+        case 33:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Commands whose text is a file name they read or write.
+inline bool commandNamesFile(int command) {
+    switch (command) {
+        case 4:
+        case 5:
+        case 19:
+        case 21:
+        case 22:
+        case 34:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Applies the flags of a session (see SessionSettings) to a document.
+template <typename Store>
+void applySettings(BasicStringArray<Store>& stringArray, const SessionSettings& settings) {
+    stringArray.setCoalescing(settings.coalesceGap);
+    stringArray.setHistoryLimit(settings.historyLimit);
+    stringArray.setCodepointColumns(settings.codepointColumns);
+}
+
+// Runs one command against the document. Shared by the interactive loop, trace replay and
+// journal recovery. Returns false only when a save or load could not open its file.
+template <typename Store>
+bool executeCommand(BasicStringArray<Store>& stringArray, const EditCommand& request) {
+    if (request.numbers.size() < commandArgumentCount(request.command)) {
+        std::cerr << "Missing arguments for command " << request.command << "." << std::endl;
+        return true;
+    }
+    const std::vector<int64_t>& n = request.numbers;
+
+    switch (request.command) {
+        case 1:
+            stringArray.addString(request.text);
+            break;
+        case 2:
+            stringArray.addEmptyLine();
+            break;
+        case 3:
+            stringArray.printStrings();
+            break;
+        case 4:
+            return stringArray.saveToFile(request.text);
+        case 5:
+            return stringArray.loadFromFile(request.text);
+        case 6:
+            SearchFunctions::searchSubstringInArray(stringArray.getStore(), request.text);
+            break;
+        case 7:
+            stringArray.insertSubstring(static_cast<int>(n[0]), static_cast<int>(n[1]), request.text, n[2] != 0);
+            break;
+        case 8:
+            stringArray.deleteSubstring(static_cast<int>(n[0]), static_cast<int>(n[1]), static_cast<int>(n[2]));
+            break;
+        case 9:
+            stringArray.undo();
+            break;
+        case 10:
+            stringArray.redo();
+            break;
+        case 11:
+            stringArray.cut(static_cast<int>(n[0]), static_cast<int>(n[1]), static_cast<int>(n[2]));
+            break;
+        case 12:
+            stringArray.copy(static_cast<int>(n[0]), static_cast<int>(n[1]), static_cast<int>(n[2]));
+            break;
+        case 13:
+            stringArray.paste(static_cast<int>(n[0]), static_cast<int>(n[1]));
+            break;
+        case 14: {
+            int lineIndex, position;
+            uint64_t offset = static_cast<uint64_t>(n[0]);
+            if (stringArray.offsetToPosition(offset, lineIndex, position)) {
+                std::cout << "Offset " << offset << " is line " << lineIndex << ", position " << position << std::endl;
+            }
+            break;
+        }
+        case 15: {
+            uint64_t offset;
+            int lineIndex = static_cast<int>(n[0]);
+            int position = static_cast<int>(n[1]);
+            if (stringArray.positionToOffset(lineIndex, position, offset)) {
+                std::cout << "Line " << lineIndex << ", position " << position << " is offset " << offset << std::endl;
+            }
+            break;
+        }
+        case 16:
+            stringArray.printStrings(static_cast<int>(n[0]), static_cast<int>(n[1]));
+            break;
+        case 17:
+            stringArray.printViewport(static_cast<int>(n[0]), static_cast<int>(n[1]));
+            break;
+        case 18:
+            StatsRegistry::printTable(std::cout);
+            break;
+        case 19: {
+            std::ofstream file(request.text);
+            if (file.is_open()) {
+                StatsRegistry::writeJson(file);
+                std::cout << "Statistics saved to " << request.text << std::endl;
+            } else {
+                std::cerr << "Error opening the file." << std::endl;
+            }
+            break;
+        }
+        case 20:
+            stringArray.printMemoryUsage(std::cout);
+            break;
+        case 21:
+            return stringArray.saveSession(request.text);
+        case 22:
+            return stringArray.loadSession(request.text);
+        case 23:
+            stringArray.paste(static_cast<int>(n[0]), static_cast<int>(n[1]), static_cast<int>(n[2]));
+            break;
+        case 24:
+            stringArray.printClipboard(std::cout);
+            break;
+        case 25:
+            stringArray.cutRange(static_cast<int>(n[0]), static_cast<int>(n[1]), static_cast<int>(n[2]),
+                                 static_cast<int>(n[3]));
+            break;
+        case 26:
+            stringArray.copyRange(static_cast<int>(n[0]), static_cast<int>(n[1]), static_cast<int>(n[2]),
+                                  static_cast<int>(n[3]));
+            break;
+        case 27:
+            stringArray.deleteRange(static_cast<int>(n[0]), static_cast<int>(n[1]), static_cast<int>(n[2]),
+                                    static_cast<int>(n[3]));
+            break;
+        case 28:
+            stringArray.beginTransaction();
+            break;
+        case 29:
+            stringArray.commitTransaction();
+            break;
+        case 30:
+            stringArray.rollbackTransaction();
+            break;
+        case 31: {
+            // The text holds the lines, each ended by '\n'.
+            std::istringstream lines(request.text);
+            stringArray.insertLines(static_cast<int>(n[0]), lines);
+            break;
+        }
+        case 32:
+            stringArray.printVersions(std::cout);
+            break;
+        case 33:
+            if (n[0] >= 0) {
+                stringArray.gotoVersion(static_cast<size_t>(n[0]));
+            } else {
+                std::cerr << "Invalid version." << std::endl;
+            }
+            break;
+        case 34:
+            stringArray.printFileDiff(std::cout, request.text);
+            break;
+        case 35:
+            // A negative second version compares with the document.
+            if (n[0] >= 0) {
+                stringArray.printVersionDiff(std::cout, static_cast<size_t>(n[0]),
+                                             n[1] >= 0 ? static_cast<size_t>(n[1]) : UndoTree<Store>::kNoVersion);
+            } else {
+                std::cerr << "Invalid version." << std::endl;
+            }
+            break;
+        default:
+            if (request.command < 0 || request.command > 35) {
+                std::cout << "The command is not implemented." << std::endl;
+            }
+            break;
+    }
+    return true;
+}
+
+#endif //HM2PP_EDITOR_COMMANDS_H
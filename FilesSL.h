@@ -0,0 +1,425 @@
+#ifndef HM2PP_FILES_SL_H
+#define HM2PP_FILES_SL_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "LineView.h"
+#include "OperationStats.h"
+#include "TextEncoding.h"
+
+// Size, modification time and identity (device and inode where the platform has them) of a
+// file. When two stamps of one path are equal, the file was almost certainly neither rewritten
+// nor replaced in between.
+struct FileStamp {
+    uint64_t size;
+    int64_t modifiedNs;
+    uint64_t device;
+    uint64_t inode;
+
+    FileStamp() : size(0), modifiedNs(0), device(0), inode(0) {}
+
+    bool operator==(const FileStamp& other) const {
+        return size == other.size && modifiedNs == other.modifiedNs && device == other.device &&
+               inode == other.inode;
+    }
+
+    bool operator!=(const FileStamp& other) const {
+        return !(*this == other);
+    }
+};
+
+class FilesSL {
+public:
+    template <typename Lines>
+    static bool saveToFile(const std::string& fileName, const Lines& data) {
+        return saveToFile(fileName, data, TextFormat());
+    }
+
+    // Writes the lines in `format`: its encoding and byte order mark, its line ending after
+    // every line, and after the last one as TextFormat::terminatesLastLine says.
+    template <typename Lines>
+    static bool saveToFile(const std::string& fileName, const Lines& data, const TextFormat& format) {
+        static OperationStats& stats = StatsRegistry::operation("FilesSL::saveToFile");
+        ScopedOperation timer(stats);
+        std::ofstream file(fileName, std::ios::binary);
+        if (file.is_open()) {
+            const size_t flushThreshold = 1 << 20;
+            std::string buffer;
+            size_t lost = 0;
+            if (format.byteOrderMark) {
+                lost += encodeText(buffer, "\xEF\xBB\xBF", 3, format);
+            }
+            for (size_t i = 0; i < data.size(); i++) {
+                LineView line = data.line(i);
+                lost += encodeText(buffer, line.data, line.size, format);
+                if (i + 1 < data.size() || format.terminatesLastLine(line.size)) {
+                    encodeText(buffer, format.newline(), format.newlineBytes(), format);
+                }
+                if (buffer.size() >= flushThreshold) {
+                    timer.addBytes(buffer.size());
+                    file.write(buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+            }
+            timer.addBytes(buffer.size());
+            file.write(buffer.data(), buffer.size());
+            file.close();
+            if (file.fail()) {
+                std::cerr << "Error writing the file." << std::endl;
+                return false;
+            }
+            if (lost != 0) {
+                std::cerr << "Warning: " << lost << " character(s) have no " << format.encodingName()
+                          << " form and were saved as '?'." << std::endl;
+            }
+            std::cout << "Array saved to " << fileName << std::endl;
+            return true;
+        } else {
+            std::cerr << "Error opening the file." << std::endl;
+            return false;
+        }
+    }
+
+    // Rewrites lines [firstLine, lastLine) of an existing file starting at byte `offset` and then
+    // cuts the file to `fileSize` bytes. Everything before `offset` is left untouched, so the
+    // caller must know it still matches the document.
+    // Only for UTF-8 formats, where the document's bytes are the file's.
+    template <typename Lines>
+    static bool patchFile(const std::string& fileName, const Lines& data, size_t firstLine, size_t lastLine,
+                          uint64_t offset, uint64_t fileSize, const TextFormat& format = TextFormat()) {
+        static OperationStats& stats = StatsRegistry::operation("FilesSL::patchFile");
+        ScopedOperation timer(stats);
+        std::fstream file(fileName, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error opening the file." << std::endl;
+            return false;
+        }
+        file.seekp(static_cast<std::streamoff>(offset));
+
+        const size_t flushThreshold = 1 << 20;
+        std::string buffer;
+        for (size_t i = firstLine; i < lastLine; i++) {
+            LineView line = data.line(i);
+            buffer.append(line.data, line.size);
+            if (i + 1 < data.size() || format.terminatesLastLine(line.size)) {
+                buffer.append(format.newline(), format.newlineBytes());
+            }
+            if (buffer.size() >= flushThreshold) {
+                timer.addBytes(buffer.size());
+                file.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        }
+        timer.addBytes(buffer.size());
+        file.write(buffer.data(), buffer.size());
+        file.close();
+        if (file.fail() || !truncateFile(fileName, fileSize)) {
+            std::cerr << "Error writing the file." << std::endl;
+            return false;
+        }
+        std::cout << "Array saved to " << fileName << std::endl;
+        return true;
+    }
+
+    // False if the file does not exist or cannot be examined.
+    static bool fileStamp(const std::string& fileName, FileStamp& stamp) {
+#if defined(_WIN32)
+        struct _stat64 info;
+        if (_stat64(fileName.c_str(), &info) != 0) {
+            return false;
+        }
+        stamp.modifiedNs = static_cast<int64_t>(info.st_mtime) * 1000000000;
+        stamp.device = 0;
+        stamp.inode = 0;
+#else
+        struct stat info;
+        if (stat(fileName.c_str(), &info) != 0) {
+            return false;
+        }
+#if defined(__APPLE__)
+        stamp.modifiedNs = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+        stamp.modifiedNs = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+        stamp.device = static_cast<uint64_t>(info.st_dev);
+        stamp.inode = static_cast<uint64_t>(info.st_ino);
+#endif
+        stamp.size = static_cast<uint64_t>(info.st_size);
+        return true;
+    }
+
+    static bool truncateFile(const std::string& fileName, uint64_t size) {
+#if defined(_WIN32)
+        std::FILE* target = std::fopen(fileName.c_str(), "r+b");
+        if (!target) {
+            return false;
+        }
+        bool ok = _chsize_s(_fileno(target), size) == 0;
+        std::fclose(target);
+        return ok;
+#else
+        return truncate(fileName.c_str(), static_cast<off_t>(size)) == 0;
+#endif
+    }
+
+    template <typename Lines>
+    static Lines loadFromFile(const std::string& fileName) {
+        Lines loadedData;
+        loadFromFile(fileName, loadedData);
+        return loadedData;
+    }
+
+    template <typename Lines>
+    static bool loadFromFile(const std::string& fileName, Lines& loadedData) {
+        TextFormat format;
+        return loadFromFile(fileName, loadedData, format);
+    }
+
+    // Appends the lines of the file to `loadedData` (a line store: push_back(data, size)) and
+    // reports how the file is encoded and terminated in `format`; returns false if the file could
+    // not be opened.
+    //
+    // The file is read once, in blocks. The first block decides the encoding (detectEncoding)
+    // and the first line terminator the line ending, however many blocks it takes to reach
+    // one and to see whether a '\r' is followed by '\n'; text in other encodings is turned into
+    // UTF-8 a block at a time on the way to the line splitter. Lines are split with memchr and
+    // a '\r' before a '\n' is dropped whatever the line ending, so files with mixed endings
+    // load clean (with a warning) and are saved with the detected one. UTF-8 lines are checked
+    // while they are still in cache; text that is not UTF-8 past the first block is loaded as
+    // it is, with a warning naming the first bad line.
+    template <typename Lines>
+    static bool loadFromFile(const std::string& fileName, Lines& loadedData, TextFormat& format) {
+        static OperationStats& stats = StatsRegistry::operation("FilesSL::loadFromFile");
+        ScopedOperation timer(stats);
+        std::ifstream file(fileName, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error opening the file." << std::endl;
+            return false;
+        }
+
+        format = TextFormat();
+        LineSplitter<Lines> splitter(loadedData);
+        const size_t blockSize = 1 << 20;
+        std::vector<char> block(blockSize);
+        std::string decoded;
+        std::string carry;
+        bool first = true;
+        bool lineEndingKnown = false;
+        bool carriageReturn = false;
+        bool atEnd = false;
+        while (!atEnd) {
+            file.read(block.data(), blockSize);
+            size_t size = static_cast<size_t>(file.gcount());
+            atEnd = size < blockSize;
+            timer.addBytes(size);
+            const char* data = block.data();
+            if (first) {
+                size_t bomBytes;
+                format.encoding = detectEncoding(data, size, bomBytes);
+                format.byteOrderMark = bomBytes != 0;
+                data += bomBytes;
+                size -= bomBytes;
+                first = false;
+            }
+
+            decoded.clear();
+            if (format.encoding == TextFormat::kLatin1) {
+                appendLatin1AsUtf8(decoded, data, size);
+                data = decoded.data();
+                size = decoded.size();
+            } else if (format.encoding != TextFormat::kUtf8) {
+                carry.append(data, size);
+                size_t used = appendUtf16AsUtf8(decoded, carry.data(), carry.size(),
+                                                format.encoding == TextFormat::kUtf16BE, atEnd);
+                carry.erase(0, used);
+                data = decoded.data();
+                size = decoded.size();
+            }
+
+            if (!lineEndingKnown) {
+                lineEndingKnown = detectLineEnding(data, size, atEnd, carriageReturn, format.lineEnding);
+                if (lineEndingKnown) {
+                    splitter.setLineEnding(format.lineEnding, format.isUtf8());
+                }
+            }
+            splitter.feed(data, size);
+        }
+        format.finalNewline = splitter.finish();
+        file.close();
+
+        if (splitter.mixedEndings != 0) {
+            std::cerr << "Warning: " << splitter.mixedEndings << " line(s) do not end in " << format.lineEndingName()
+                      << "; saving will use it for every line." << std::endl;
+        }
+        if (splitter.invalidLines != 0) {
+            std::cerr << "Warning: " << splitter.invalidLines << " line(s) are not valid UTF-8, the first is line "
+                      << splitter.firstInvalidLine << " at byte " << splitter.firstInvalidByte << "." << std::endl;
+        }
+        std::cout << "Array loaded from " << fileName;
+        if (!format.isDefault()) {
+            std::cout << " (" << format.describe() << ")";
+        }
+        std::cout << std::endl;
+        return true;
+    }
+
+private:
+    // Appends text to `out` in the format's encoding; returns the characters it could not encode.
+    static size_t encodeText(std::string& out, const char* data, size_t size, const TextFormat& format) {
+        switch (format.encoding) {
+            case TextFormat::kLatin1:
+                return appendUtf8AsLatin1(out, data, size);
+            case TextFormat::kUtf16LE:
+            case TextFormat::kUtf16BE:
+                appendUtf8AsUtf16(out, data, size, format.encoding == TextFormat::kUtf16BE);
+                return 0;
+            default:
+                out.append(data, size);
+                return 0;
+        }
+    }
+
+    // Sets `ending` to the line ending of the first terminator in the text read so far, of which
+    // `data` is the next block and `carriageReturn` says whether the text before it ended in a
+    // '\r'. Returns false while more text is needed to decide: no terminator yet, or a final
+    // '\r' that may still be followed by '\n'. At the end of the text a '\r' is CR, and a text
+    // without terminators LF.
+    static bool detectLineEnding(const char* data, size_t size, bool atEnd, bool& carriageReturn,
+                                 TextFormat::LineEnding& ending) {
+        for (size_t i = 0; i < size; i++) {
+            if (carriageReturn) {
+                ending = data[i] == '\n' ? TextFormat::kCRLF : TextFormat::kCR;
+                return true;
+            }
+            if (data[i] == '\n') {
+                ending = TextFormat::kLF;
+                return true;
+            }
+            carriageReturn = data[i] == '\r';
+        }
+        if (!atEnd) {
+            return false;
+        }
+        ending = carriageReturn ? TextFormat::kCR : TextFormat::kLF;
+        return true;
+    }
+
+    // Splits UTF-8 text fed in blocks into lines. A line cut by the end of a block waits in
+    // `pending` for the rest.
+    template <typename Lines>
+    class LineSplitter {
+    private:
+        Lines& lines;
+        std::string pending;
+        char terminator;
+        bool expectCarriageReturn;
+        bool validate;
+        bool skipLineFeed;
+        size_t lineNumber;
+
+        void push(const char* data, size_t size, bool carriageReturn) {
+            lineNumber++;
+            if (expectCarriageReturn != carriageReturn) {
+                mixedEndings++;
+            }
+            if (validate) {
+                size_t valid = validateUtf8(data, size);
+                if (valid != size && invalidLines++ == 0) {
+                    firstInvalidLine = lineNumber;
+                    firstInvalidByte = valid;
+                }
+            }
+            lines.push_back(data, size);
+        }
+
+        // Ends the line made of `pending` and data[start, end).
+        void endLine(const char* data, size_t start, size_t end) {
+            const char* text = data + start;
+            size_t size = end - start;
+            if (!pending.empty()) {
+                pending.append(text, size);
+                text = pending.data();
+                size = pending.size();
+            }
+            bool carriageReturn = terminator == '\n' && size != 0 && text[size - 1] == '\r';
+            push(text, size - carriageReturn, carriageReturn || terminator == '\r');
+            pending.clear();
+        }
+
+    public:
+        size_t mixedEndings;
+        size_t invalidLines;
+        size_t firstInvalidLine;
+        size_t firstInvalidByte;
+
+        explicit LineSplitter(Lines& lines)
+            : lines(lines), terminator('\n'), expectCarriageReturn(false), validate(true), skipLineFeed(false),
+              lineNumber(0), mixedEndings(0), invalidLines(0), firstInvalidLine(0), firstInvalidByte(0) {}
+
+        // Text fed before the line ending is known holds no terminator except perhaps a final
+        // '\r'; if that turns out to be a CR terminator, it ends the line waiting in `pending`.
+        void setLineEnding(TextFormat::LineEnding ending, bool validateText) {
+            terminator = ending == TextFormat::kCR ? '\r' : '\n';
+            expectCarriageReturn = ending != TextFormat::kLF;
+            validate = validateText;
+            if (terminator == '\r' && !pending.empty() && pending.back() == '\r') {
+                pending.pop_back();
+                push(pending.data(), pending.size(), true);
+                pending.clear();
+            }
+        }
+
+        void feed(const char* data, size_t size) {
+            size_t i = 0;
+            if (skipLineFeed && size != 0) {
+                // The '\n' of a "\r\n" in a CR file.
+                i = data[0] == '\n' ? 1 : 0;
+                skipLineFeed = false;
+            }
+            while (i < size) {
+                const void* found = std::memchr(data + i, terminator, size - i);
+                if (!found) {
+                    pending.append(data + i, size - i);
+                    return;
+                }
+                size_t end = static_cast<const char*>(found) - data;
+                endLine(data, i, end);
+                i = end + 1;
+                if (terminator == '\r') {
+                    if (i == size) {
+                        skipLineFeed = true;
+                    } else if (data[i] == '\n') {
+                        i++;
+                    }
+                }
+            }
+        }
+
+        // Ends the last line; returns whether the text ended with a terminator.
+        bool finish() {
+            if (pending.empty()) {
+                return true;
+            }
+            push(pending.data(), pending.size(), expectCarriageReturn);
+            pending.clear();
+            return false;
+        }
+    };
+};
+
+#endif //HM2PP_FILES_SL_H
@@ -0,0 +1,25 @@
+#ifndef HM2PP_HASHING_H
+#define HM2PP_HASHING_H
+
+#include <cstdint>
+#include <cstring>
+
+// Fast non-cryptographic 64-bit hash of a byte range, eight bytes per step.
+inline uint64_t hashBytes(const char* data, size_t size) {
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ULL;
+    uint64_t hash = size * multiplier;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, data + i, size - i);
+    hash = (hash ^ tail) * multiplier;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+#endif //HM2PP_HASHING_H
@@ -0,0 +1,399 @@
+#ifndef HM2PP_INTERNED_LINE_STORE_H
+#define HM2PP_INTERNED_LINE_STORE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Hashing.h"
+#include "LineView.h"
+#include "MemoryUsage.h"
+#include "TextSlice.h"
+
+class LineInternTable;
+
+// Immutable, reference-counted line content shared by every line (and every history
+// snapshot) that holds the same text.
+struct InternedLine {
+    LineInternTable* table;
+    uint64_t hash;
+    size_t refs;
+    std::string text;
+};
+
+// Open-addressing hash set of interned lines, keyed by content. Entries are removed as soon
+// as their last reference is released.
+class LineInternTable {
+private:
+    std::vector<InternedLine*> slots;
+    size_t count;
+
+    size_t mask() const {
+        return slots.size() - 1;
+    }
+
+    size_t findSlot(uint64_t hash, const char* data, size_t size) const {
+        size_t slot = hash & mask();
+        while (slots[slot] != nullptr) {
+            const InternedLine* node = slots[slot];
+            if (node->hash == hash && node->text.size() == size && std::memcmp(node->text.data(), data, size) == 0) {
+                return slot;
+            }
+            slot = (slot + 1) & mask();
+        }
+        return slot;
+    }
+
+    void insertNode(InternedLine* node) {
+        if ((count + 1) * 10 > slots.size() * 7) {
+            grow();
+        }
+        size_t slot = node->hash & mask();
+        while (slots[slot] != nullptr) {
+            slot = (slot + 1) & mask();
+        }
+        slots[slot] = node;
+        count++;
+    }
+
+    void grow() {
+        std::vector<InternedLine*> old(slots.size() * 2, nullptr);
+        old.swap(slots);
+        count = 0;
+        for (InternedLine* node : old) {
+            if (node) {
+                insertNode(node);
+            }
+        }
+    }
+
+public:
+    LineInternTable() : slots(64, nullptr), count(0) {}
+
+    LineInternTable(const LineInternTable&) = delete;
+    LineInternTable& operator=(const LineInternTable&) = delete;
+
+    ~LineInternTable() {
+        for (InternedLine* node : slots) {
+            delete node;
+        }
+    }
+
+    // Returns the shared node for this text with one more reference taken.
+    InternedLine* intern(const char* data, size_t size) {
+        uint64_t hash = hashBytes(data, size);
+        size_t slot = findSlot(hash, data, size);
+        if (slots[slot] != nullptr) {
+            slots[slot]->refs++;
+            return slots[slot];
+        }
+        InternedLine* node = new InternedLine{this, hash, 1, std::string(data, size)};
+        insertNode(node);
+        return node;
+    }
+
+    // Re-keys a node whose text was just changed by its only owner. Returns the node that now
+    // represents the text, which is an existing one when the new text was already interned.
+    InternedLine* rehash(InternedLine* node) {
+        node->hash = hashBytes(node->text.data(), node->text.size());
+        size_t slot = findSlot(node->hash, node->text.data(), node->text.size());
+        if (slots[slot] != nullptr) {
+            slots[slot]->refs++;
+            delete node;
+            return slots[slot];
+        }
+        insertNode(node);
+        return node;
+    }
+
+    // Removes a node from the set without freeing it (backward-shift deletion).
+    void unlink(InternedLine* node) {
+        size_t hole = node->hash & mask();
+        while (slots[hole] != node) {
+            hole = (hole + 1) & mask();
+        }
+        slots[hole] = nullptr;
+        count--;
+
+        size_t next = hole;
+        while (true) {
+            next = (next + 1) & mask();
+            if (slots[next] == nullptr) {
+                break;
+            }
+            size_t home = slots[next]->hash & mask();
+            bool movable = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+            if (movable) {
+                slots[hole] = slots[next];
+                slots[next] = nullptr;
+                hole = next;
+            }
+        }
+    }
+
+    static void retain(InternedLine* node) {
+        node->refs++;
+    }
+
+    static void release(InternedLine* node) {
+        if (--node->refs == 0) {
+            node->table->unlink(node);
+            delete node;
+        }
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addVector(slots);
+        for (const InternedLine* node : slots) {
+            if (node) {
+                usage.addBlock(sizeof(InternedLine), sizeof(InternedLine));
+                usage.addString(node->text);
+            }
+        }
+        return usage;
+    }
+};
+
+// Line store that hash-conses line contents: identical lines share one immutable node, edits
+// are copy-on-write, and a history snapshot is just a vector of node references, so lines the
+// edit did not touch cost no copies.
+class InternedLineStore {
+private:
+    std::shared_ptr<LineInternTable> table;
+    std::vector<InternedLine*> lines;
+
+    void releaseAll() {
+        for (InternedLine* node : lines) {
+            LineInternTable::release(node);
+        }
+        lines.clear();
+    }
+
+public:
+    class Snapshot {
+    private:
+        std::shared_ptr<LineInternTable> table;
+        std::vector<InternedLine*> lines;
+
+        friend class InternedLineStore;
+
+    public:
+        Snapshot(const std::shared_ptr<LineInternTable>& table, const std::vector<InternedLine*>& source)
+            : table(table), lines(source) {
+            for (InternedLine* node : lines) {
+                LineInternTable::retain(node);
+            }
+        }
+
+        Snapshot(Snapshot&& other) noexcept : table(std::move(other.table)), lines(std::move(other.lines)) {
+            other.lines.clear();
+        }
+
+        Snapshot& operator=(Snapshot&& other) noexcept {
+            if (this != &other) {
+                for (InternedLine* node : lines) {
+                    LineInternTable::release(node);
+                }
+                table = std::move(other.table);
+                lines = std::move(other.lines);
+                other.lines.clear();
+            }
+            return *this;
+        }
+
+        ~Snapshot() {
+            for (InternedLine* node : lines) {
+                LineInternTable::release(node);
+            }
+        }
+
+        size_t size() const {
+            return lines.size();
+        }
+
+        LineView line(size_t index) const {
+            return lines[index]->text;
+        }
+
+        uint64_t textBytes() const {
+            uint64_t total = 0;
+            for (InternedLine* node : lines) {
+                total += node->text.size();
+            }
+            return total;
+        }
+
+        // Only the references; the shared line contents are reported by the store's table.
+        MemoryUsage memoryUsage() const {
+            MemoryUsage usage;
+            usage.addVector(lines);
+            return usage;
+        }
+    };
+
+    InternedLineStore() : table(std::make_shared<LineInternTable>()) {}
+
+    InternedLineStore(const InternedLineStore&) = delete;
+    InternedLineStore& operator=(const InternedLineStore&) = delete;
+
+    InternedLineStore(InternedLineStore&& other) : table(other.table), lines(std::move(other.lines)) {
+        other.lines.clear();
+    }
+
+    InternedLineStore& operator=(InternedLineStore&& other) {
+        if (this != &other) {
+            releaseAll();
+            table = other.table;
+            lines = std::move(other.lines);
+            other.lines.clear();
+        }
+        return *this;
+    }
+
+    ~InternedLineStore() {
+        releaseAll();
+    }
+
+    size_t size() const {
+        return lines.size();
+    }
+
+    LineView line(size_t index) const {
+        return lines[index]->text;
+    }
+
+    template <typename Edit>
+    void modify(size_t index, Edit edit) {
+        InternedLine* node = lines[index];
+        if (node->refs == 1) {
+            // Sole owner: edit the node in place instead of copying it.
+            table->unlink(node);
+            edit(node->text);
+            lines[index] = table->rehash(node);
+            return;
+        }
+        std::string text = node->text;
+        edit(text);
+        lines[index] = table->intern(text.data(), text.size());
+        LineInternTable::release(node);
+    }
+
+    // References the line's node instead of copying it: the node is immutable while shared, so
+    // the reference only makes the next edit of that line copy-on-write. The table stays alive
+    // with the slice because releasing the node unlinks it.
+    TextSlice share(size_t index, size_t position, size_t length) const {
+        InternedLine* node = lines[index];
+        LineInternTable::retain(node);
+        std::shared_ptr<LineInternTable> owner = table;
+        std::shared_ptr<const void> holder(node, [owner](InternedLine* shared) { LineInternTable::release(shared); });
+        return TextSlice(holder, node->text.data() + position, length);
+    }
+
+    void push_back(const char* data, size_t size) {
+        lines.push_back(table->intern(data, size));
+    }
+
+    void push_back(const std::string& line) {
+        push_back(line.data(), line.size());
+    }
+
+    // Replaces lines [first, first + count) with `n` new ones. `data` must not point into the store.
+    void splice(size_t first, size_t count, const LineView* data, size_t n) {
+        std::vector<InternedLine*> inserted;
+        inserted.reserve(n);
+        for (size_t i = 0; i < n; i++) {
+            inserted.push_back(table->intern(data[i].data, data[i].size));
+        }
+        for (size_t i = first; i < first + count; i++) {
+            LineInternTable::release(lines[i]);
+        }
+        size_t common = std::min(count, n);
+        std::copy(inserted.begin(), inserted.begin() + common, lines.begin() + first);
+        if (count > n) {
+            lines.erase(lines.begin() + first + n, lines.begin() + first + count);
+        } else {
+            lines.insert(lines.begin() + first + count, inserted.begin() + common, inserted.end());
+        }
+    }
+
+    void assign(const std::vector<std::string>& data) {
+        releaseAll();
+        lines.reserve(data.size());
+        for (const std::string& line : data) {
+            push_back(line);
+        }
+    }
+
+    // Lines equal to the one already at the same index keep their node, so assigning a series
+    // of similar documents (restoring a session's history) mostly skips the intern table.
+    void assign(const LineView* data, size_t count) {
+        for (size_t i = count; i < lines.size(); i++) {
+            LineInternTable::release(lines[i]);
+        }
+        lines.resize(std::min(lines.size(), count));
+        for (size_t i = 0; i < lines.size(); i++) {
+            const std::string& text = lines[i]->text;
+            if (text.size() != data[i].size || std::memcmp(text.data(), data[i].data, text.size()) != 0) {
+                InternedLine* node = table->intern(data[i].data, data[i].size);
+                LineInternTable::release(lines[i]);
+                lines[i] = node;
+            }
+        }
+        lines.reserve(count);
+        for (size_t i = lines.size(); i < count; i++) {
+            push_back(data[i].data, data[i].size);
+        }
+    }
+
+    std::vector<std::string> toVector() const {
+        std::vector<std::string> result;
+        result.reserve(lines.size());
+        for (InternedLine* node : lines) {
+            result.push_back(node->text);
+        }
+        return result;
+    }
+
+    // Copies the lines out and empties the store; its text is not kept as std::strings.
+    std::vector<std::string> release() {
+        std::vector<std::string> result = toVector();
+        assign(std::vector<std::string>());
+        return result;
+    }
+
+    Snapshot snapshot() const {
+        return Snapshot(table, lines);
+    }
+
+    void restore(const Snapshot& snapshot) {
+        for (InternedLine* node : snapshot.lines) {
+            LineInternTable::retain(node);
+        }
+        releaseAll();
+        table = snapshot.table;
+        lines = snapshot.lines;
+    }
+
+    size_t uniqueLineCount() const {
+        return table->size();
+    }
+
+    // Includes the whole intern table, which also holds lines referenced only by history.
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addVector(lines);
+        usage.addBlock(sizeof(LineInternTable), sizeof(LineInternTable));
+        usage += table->memoryUsage();
+        return usage;
+    }
+};
+
+#endif //HM2PP_INTERNED_LINE_STORE_H
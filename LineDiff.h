@@ -0,0 +1,423 @@
+#ifndef HM2PP_LINE_DIFF_H
+#define HM2PP_LINE_DIFF_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Hashing.h"
+#include "LineView.h"
+
+// One difference between two documents: lines [oldFirst, oldFirst + oldCount) of the old one
+// become lines [newFirst, newFirst + newCount) of the new one. Lines are 0-based; either count
+// may be 0.
+struct LineChange {
+    size_t oldFirst;
+    size_t oldCount;
+    size_t newFirst;
+    size_t newCount;
+};
+
+// Line diff of two documents, each anything with size() and line(i): stores, their snapshots,
+// unpacked history versions, LineRanges. compare() returns a shortest edit script as the
+// changes in document order, so it also serves as the minimal delta between two versions;
+// writeUnified() prints it.
+//
+// Every line is hashed once and mapped to a class id shared by all lines with its text, so the
+// rest works on integers. The common prefix and suffix are cut off, as are the lines whose text
+// the other side lacks, which can only be changes; this keeps unrelated documents linear. What
+// is left goes to Myers' O(ND) algorithm in its linear-space form: find the middle snake of the
+// edit graph by searching forward and backward at once, then solve both halves. Like GNU diff
+// and git, a search that passes max(256, sqrt(lines)) edits settles for the furthest point
+// either side reached, so heavily reordered documents stay fast at the price of a script that
+// may be longer than the shortest.
+class LineDiff {
+private:
+    static const uint32_t kNoClass = 0xFFFFFFFF;
+
+    struct Slot {
+        uint64_t hash;
+        uint32_t lineClass;
+    };
+
+    // Open-addressing table from line hash to class; a class remembers its first line, counting
+    // the old document's lines first and the new one's after them.
+    std::vector<Slot> slots;
+    std::vector<size_t> representatives;
+    std::string scratch;
+
+    // Classes of the lines left after trimming and discarding, and the line numbers they had.
+    std::vector<uint32_t> oldClasses;
+    std::vector<uint32_t> newClasses;
+    std::vector<size_t> oldLineNumbers;
+    std::vector<size_t> newLineNumbers;
+
+    // Furthest x reached on each diagonal, searching forward and backward.
+    std::vector<int64_t> forward;
+    std::vector<int64_t> backward;
+
+    std::vector<LineChange> changes;
+    size_t nextOld;
+    size_t nextNew;
+
+    LineDiff() : nextOld(0), nextNew(0) {}
+
+    template <typename OldLines, typename NewLines>
+    static LineView lineAt(const OldLines& oldLines, const NewLines& newLines, size_t number) {
+        return number < oldLines.size() ? oldLines.line(number) : newLines.line(number - oldLines.size());
+    }
+
+    void grow() {
+        std::vector<Slot> old(slots.size() * 2, Slot{0, kNoClass});
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for (const Slot& entry : old) {
+            if (entry.lineClass != kNoClass) {
+                size_t slot = entry.hash & mask;
+                while (slots[slot].lineClass != kNoClass) {
+                    slot = (slot + 1) & mask;
+                }
+                slots[slot] = entry;
+            }
+        }
+    }
+
+    // Class of line `number`. Unless `exact`, lines with equal hashes are taken to be equal; the
+    // result is checked afterwards instead (see run()), which reads the lines in order rather
+    // than jumping to each class's first line. Paged snapshots read through a shared one-block
+    // buffer, so the line is copied before a line it may equal is read for the comparison.
+    template <typename OldLines, typename NewLines>
+    uint32_t classify(const OldLines& oldLines, const NewLines& newLines, size_t number, LineView line, bool exact) {
+        if ((representatives.size() + 1) * 10 > slots.size() * 7) {
+            grow();
+        }
+        uint64_t hash = hashBytes(line.data, line.size);
+        size_t mask = slots.size() - 1;
+        size_t slot = hash & mask;
+        bool copied = false;
+        while (slots[slot].lineClass != kNoClass) {
+            if (slots[slot].hash == hash) {
+                if (!exact) {
+                    return slots[slot].lineClass;
+                }
+                if (!copied) {
+                    scratch.assign(line.data, line.size);
+                    copied = true;
+                }
+                LineView other = lineAt(oldLines, newLines, representatives[slots[slot].lineClass]);
+                if (other.size == scratch.size() && std::memcmp(other.data, scratch.data(), other.size) == 0) {
+                    return slots[slot].lineClass;
+                }
+            }
+            slot = (slot + 1) & mask;
+        }
+        uint32_t lineClass = static_cast<uint32_t>(representatives.size());
+        slots[slot] = Slot{hash, lineClass};
+        representatives.push_back(number);
+        return lineClass;
+    }
+
+    // Records that old line `oldLine` and new line `newLine` are kept; matches come in order.
+    void match(size_t oldLine, size_t newLine) {
+        changeUpTo(oldLine, newLine);
+        nextOld = oldLine + 1;
+        nextNew = newLine + 1;
+    }
+
+    void changeUpTo(size_t oldLine, size_t newLine) {
+        if (oldLine != nextOld || newLine != nextNew) {
+            changes.push_back(LineChange{nextOld, oldLine - nextOld, nextNew, newLine - nextNew});
+        }
+    }
+
+    // Finds where a shortest path through the edit graph of old [oldLow, oldHigh) and new
+    // [newLow, newHigh) crosses its middle diagonal band, from the two searches' overlap. Past
+    // `maxCost` edits it gives up on the overlap and splits at the furthest point reached.
+    bool middleSnake(size_t oldLow, size_t oldHigh, size_t newLow, size_t newHigh, int64_t maxCost,
+                     size_t& oldSplit, size_t& newSplit) {
+        const uint32_t* a = oldClasses.data() + oldLow;
+        const uint32_t* b = newClasses.data() + newLow;
+        int64_t n = static_cast<int64_t>(oldHigh - oldLow);
+        int64_t m = static_cast<int64_t>(newHigh - newLow);
+        int64_t maxD = std::min((n + m + 1) / 2, maxCost);
+        int64_t offset = maxD;
+        int64_t length = 2 * maxD + 2;
+        forward.assign(length, -1);
+        backward.assign(length, -1);
+        forward[offset + 1] = 0;
+        backward[offset + 1] = 0;
+        int64_t delta = n - m;
+        // With an odd delta the forward search is the one that reaches the overlap first.
+        bool forwardMeets = (delta & 1) != 0;
+        // Diagonals that ran off the grid are not searched again.
+        int64_t forwardStart = 0, forwardEnd = 0, backwardStart = 0, backwardEnd = 0;
+
+        for (int64_t d = 0; d < maxD; d++) {
+            for (int64_t k = -d + forwardStart; k <= d - forwardEnd; k += 2) {
+                int64_t index = offset + k;
+                int64_t x = k == -d || (k != d && forward[index - 1] < forward[index + 1]) ? forward[index + 1]
+                                                                                           : forward[index - 1] + 1;
+                int64_t y = x - k;
+                while (x < n && y < m && a[x] == b[y]) {
+                    x++;
+                    y++;
+                }
+                forward[index] = x;
+                if (x > n) {
+                    forwardEnd += 2;
+                } else if (y > m) {
+                    forwardStart += 2;
+                } else if (forwardMeets) {
+                    int64_t other = offset + delta - k;
+                    if (other >= 0 && other < length && backward[other] != -1 && x >= n - backward[other]) {
+                        oldSplit = oldLow + static_cast<size_t>(x);
+                        newSplit = newLow + static_cast<size_t>(y);
+                        return true;
+                    }
+                }
+            }
+
+            for (int64_t k = -d + backwardStart; k <= d - backwardEnd; k += 2) {
+                int64_t index = offset + k;
+                int64_t x = k == -d || (k != d && backward[index - 1] < backward[index + 1]) ? backward[index + 1]
+                                                                                             : backward[index - 1] + 1;
+                int64_t y = x - k;
+                while (x < n && y < m && a[n - x - 1] == b[m - y - 1]) {
+                    x++;
+                    y++;
+                }
+                backward[index] = x;
+                if (x > n) {
+                    backwardEnd += 2;
+                } else if (y > m) {
+                    backwardStart += 2;
+                } else if (!forwardMeets) {
+                    int64_t other = offset + delta - k;
+                    if (other >= 0 && other < length && forward[other] != -1 && forward[other] >= n - x) {
+                        int64_t forwardX = forward[other];
+                        oldSplit = oldLow + static_cast<size_t>(forwardX);
+                        newSplit = newLow + static_cast<size_t>(forwardX - (other - offset));
+                        return true;
+                    }
+                }
+            }
+        }
+
+        // Every point the searches recorded lies on some path from its corner; take the one that
+        // got furthest, unless it is a corner itself and splitting there would not shrink anything.
+        int64_t best = 0;
+        for (int64_t index = 0; index < length; index++) {
+            int64_t k = index - offset;
+            int64_t x = forward[index];
+            if (x >= 0 && x <= n && x - k >= 0 && x - k <= m && x + x - k > best && (x < n || x - k < m)) {
+                best = x + x - k;
+                oldSplit = oldLow + static_cast<size_t>(x);
+                newSplit = newLow + static_cast<size_t>(x - k);
+            }
+            x = backward[index];
+            if (x >= 0 && x <= n && x - k >= 0 && x - k <= m && x + x - k > best && (x < n || x - k < m)) {
+                best = x + x - k;
+                oldSplit = oldHigh - static_cast<size_t>(x);
+                newSplit = newHigh - static_cast<size_t>(x - k);
+            }
+        }
+        return best != 0;
+    }
+
+    void compareRange(size_t oldLow, size_t oldHigh, size_t newLow, size_t newHigh, int64_t maxCost) {
+        while (oldLow < oldHigh && newLow < newHigh && oldClasses[oldLow] == newClasses[newLow]) {
+            match(oldLineNumbers[oldLow], newLineNumbers[newLow]);
+            oldLow++;
+            newLow++;
+        }
+        size_t suffix = 0;
+        while (oldLow + suffix < oldHigh && newLow + suffix < newHigh &&
+               oldClasses[oldHigh - suffix - 1] == newClasses[newHigh - suffix - 1]) {
+            suffix++;
+        }
+        oldHigh -= suffix;
+        newHigh -= suffix;
+
+        size_t oldSplit, newSplit;
+        if (oldLow < oldHigh && newLow < newHigh &&
+            middleSnake(oldLow, oldHigh, newLow, newHigh, maxCost, oldSplit, newSplit)) {
+            compareRange(oldLow, oldSplit, newLow, newSplit, maxCost);
+            compareRange(oldSplit, oldHigh, newSplit, newHigh, maxCost);
+        }
+        for (size_t i = 0; i < suffix; i++) {
+            match(oldLineNumbers[oldHigh + i], newLineNumbers[newHigh + i]);
+        }
+    }
+
+    template <typename OldLines, typename NewLines>
+    void compute(const OldLines& oldLines, const NewLines& newLines, bool exact) {
+        slots.assign(1024, Slot{0, kNoClass});
+        representatives.clear();
+        oldClasses.clear();
+        newClasses.clear();
+        oldLineNumbers.clear();
+        newLineNumbers.clear();
+        changes.clear();
+
+        size_t oldSize = oldLines.size();
+        size_t newSize = newLines.size();
+        std::vector<uint32_t> oldAll(oldSize);
+        std::vector<uint32_t> newAll(newSize);
+        for (size_t i = 0; i < oldSize; i++) {
+            oldAll[i] = classify(oldLines, newLines, i, oldLines.line(i), exact);
+        }
+        for (size_t i = 0; i < newSize; i++) {
+            newAll[i] = classify(oldLines, newLines, oldSize + i, newLines.line(i), exact);
+        }
+        std::vector<Slot>().swap(slots);
+
+        size_t prefix = 0;
+        while (prefix < oldSize && prefix < newSize && oldAll[prefix] == newAll[prefix]) {
+            prefix++;
+        }
+        size_t oldEnd = oldSize;
+        size_t newEnd = newSize;
+        while (oldEnd > prefix && newEnd > prefix && oldAll[oldEnd - 1] == newAll[newEnd - 1]) {
+            oldEnd--;
+            newEnd--;
+        }
+
+        // Bit 1: the class occurs in the old middle, bit 2: in the new one.
+        std::vector<unsigned char> sides(representatives.size(), 0);
+        for (size_t i = prefix; i < oldEnd; i++) {
+            sides[oldAll[i]] |= 1;
+        }
+        for (size_t i = prefix; i < newEnd; i++) {
+            sides[newAll[i]] |= 2;
+        }
+        for (size_t i = prefix; i < oldEnd; i++) {
+            if (sides[oldAll[i]] & 2) {
+                oldClasses.push_back(oldAll[i]);
+                oldLineNumbers.push_back(i);
+            }
+        }
+        for (size_t i = prefix; i < newEnd; i++) {
+            if (sides[newAll[i]] & 1) {
+                newClasses.push_back(newAll[i]);
+                newLineNumbers.push_back(i);
+            }
+        }
+
+        nextOld = prefix;
+        nextNew = prefix;
+        int64_t maxCost = std::max<int64_t>(256, static_cast<int64_t>(std::sqrt(static_cast<double>(
+            oldClasses.size() + newClasses.size()))));
+        compareRange(0, oldClasses.size(), 0, newClasses.size(), maxCost);
+        changeUpTo(oldEnd, newEnd);
+    }
+
+    // Whether every line the changes leave alone really equals its counterpart.
+    template <typename OldLines, typename NewLines>
+    bool keptLinesEqual(const OldLines& oldLines, const NewLines& newLines) {
+        size_t oldLine = 0;
+        size_t newLine = 0;
+        for (size_t i = 0; i <= changes.size(); i++) {
+            size_t oldEnd = i < changes.size() ? changes[i].oldFirst : oldLines.size();
+            for (; oldLine < oldEnd; oldLine++, newLine++) {
+                LineView line = oldLines.line(oldLine);
+                scratch.assign(line.data, line.size);
+                LineView other = newLines.line(newLine);
+                if (other.size != scratch.size() || std::memcmp(other.data, scratch.data(), other.size) != 0) {
+                    return false;
+                }
+            }
+            if (i < changes.size()) {
+                oldLine += changes[i].oldCount;
+                newLine = changes[i].newFirst + changes[i].newCount;
+            }
+        }
+        return true;
+    }
+
+    // Diffs by hash first; only a hash collision, which the check finds, costs a second pass.
+    template <typename OldLines, typename NewLines>
+    void run(const OldLines& oldLines, const NewLines& newLines) {
+        compute(oldLines, newLines, false);
+        if (!keptLinesEqual(oldLines, newLines)) {
+            compute(oldLines, newLines, true);
+        }
+    }
+
+    // "first,count" as unified diffs write it: 1-based, the count left out when it is 1, and an
+    // empty range named by the line before it.
+    static void writeRange(std::ostream& out, size_t first, size_t count) {
+        if (count == 1) {
+            out << first + 1;
+        } else {
+            out << (count == 0 ? first : first + 1) << ',' << count;
+        }
+    }
+
+    template <typename Lines>
+    static void writeLines(std::ostream& out, char marker, const Lines& lines, size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) {
+            out << marker << lines.line(i) << '\n';
+        }
+    }
+
+public:
+    template <typename OldLines, typename NewLines>
+    static std::vector<LineChange> compare(const OldLines& oldLines, const NewLines& newLines) {
+        LineDiff diff;
+        diff.run(oldLines, newLines);
+        return std::move(diff.changes);
+    }
+
+    // Writes `changes`, as compare() returned them for these documents, as a unified diff with
+    // `context` unchanged lines around each change; changes closer than twice that share a hunk.
+    // Writes nothing when there are no changes.
+    template <typename OldLines, typename NewLines>
+    static void writeUnified(std::ostream& out, const std::string& oldName, const OldLines& oldLines,
+                             const std::string& newName, const NewLines& newLines,
+                             const std::vector<LineChange>& changes, size_t context = 3) {
+        if (changes.empty()) {
+            return;
+        }
+        out << "--- " << oldName << '\n' << "+++ " << newName << '\n';
+        size_t first = 0;
+        while (first < changes.size()) {
+            size_t last = first;
+            while (last + 1 < changes.size() &&
+                   changes[last + 1].oldFirst - (changes[last].oldFirst + changes[last].oldCount) <= 2 * context) {
+                last++;
+            }
+            // The lines between changes are unchanged, so they are at the same distance from a
+            // change in both documents.
+            size_t leading = std::min(context, changes[first].oldFirst);
+            size_t oldStart = changes[first].oldFirst - leading;
+            size_t newStart = changes[first].newFirst - leading;
+            size_t lastOld = changes[last].oldFirst + changes[last].oldCount;
+            size_t trailing = std::min(context, oldLines.size() - lastOld);
+            size_t oldEnd = lastOld + trailing;
+            size_t newEnd = changes[last].newFirst + changes[last].newCount + trailing;
+
+            out << "@@ -";
+            writeRange(out, oldStart, oldEnd - oldStart);
+            out << " +";
+            writeRange(out, newStart, newEnd - newStart);
+            out << " @@\n";
+            size_t oldLine = oldStart;
+            for (size_t i = first; i <= last; i++) {
+                const LineChange& change = changes[i];
+                writeLines(out, ' ', oldLines, oldLine, change.oldFirst);
+                writeLines(out, '-', oldLines, change.oldFirst, change.oldFirst + change.oldCount);
+                writeLines(out, '+', newLines, change.newFirst, change.newFirst + change.newCount);
+                oldLine = change.oldFirst + change.oldCount;
+            }
+            writeLines(out, ' ', oldLines, oldLine, oldEnd);
+            first = last + 1;
+        }
+        out.flush();
+    }
+};
+
+#endif //HM2PP_LINE_DIFF_H
@@ -0,0 +1,241 @@
+#ifndef HM2PP_LINE_OFFSET_INDEX_H
+#define HM2PP_LINE_OFFSET_INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "LineView.h"
+#include "MemoryUsage.h"
+#include "Utf8.h"
+
+// Fenwick (binary indexed) tree over a sequence of non-negative values: point updates,
+// prefix sums and prefix-sum search in O(log n), appends in O(log n).
+class FenwickTree {
+private:
+    std::vector<uint64_t> tree;
+
+    static size_t lowBit(size_t i) {
+        return i & (~i + 1);
+    }
+
+public:
+    size_t size() const {
+        return tree.empty() ? 0 : tree.size() - 1;
+    }
+
+    void clear() {
+        tree.clear();
+    }
+
+    void build(const std::vector<uint64_t>& values) {
+        tree.assign(values.size() + 1, 0);
+        for (size_t i = 1; i <= values.size(); i++) {
+            tree[i] += values[i - 1];
+            size_t parent = i + lowBit(i);
+            if (parent <= values.size()) {
+                tree[parent] += tree[i];
+            }
+        }
+    }
+
+    void append(uint64_t value) {
+        if (tree.empty()) {
+            tree.push_back(0);
+        }
+        size_t i = tree.size();
+        tree.push_back(value + prefix(i - 1) - prefix(i - lowBit(i)));
+    }
+
+    void add(size_t index, int64_t delta) {
+        for (size_t i = index + 1; i < tree.size(); i += lowBit(i)) {
+            tree[i] += delta;
+        }
+    }
+
+    void set(size_t index, uint64_t value) {
+        add(index, static_cast<int64_t>(value - this->value(index)));
+    }
+
+    // Sum of the first `count` values.
+    uint64_t prefix(size_t count) const {
+        uint64_t sum = 0;
+        for (size_t i = count; i > 0; i -= lowBit(i)) {
+            sum += tree[i];
+        }
+        return sum;
+    }
+
+    uint64_t value(size_t index) const {
+        return prefix(index + 1) - prefix(index);
+    }
+
+    uint64_t total() const {
+        return prefix(size());
+    }
+
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addVector(tree);
+        return usage;
+    }
+
+    // Largest `count` with prefix(count) + count * extra <= target, that is, searching as if
+    // every value were `extra` larger; also reports what is left of the target.
+    size_t search(uint64_t target, uint64_t& remainder, uint64_t extra = 0) const {
+        size_t position = 0;
+        size_t step = 1;
+        while (step * 2 <= size()) {
+            step *= 2;
+        }
+        for (; step > 0; step /= 2) {
+            // Node position + step sums the `step` values after `position`.
+            if (position + step <= size() && tree[position + step] + step * extra <= target) {
+                position += step;
+                target -= tree[position] + step * extra;
+            }
+        }
+        remainder = target;
+        return position;
+    }
+};
+
+// Maps absolute document offsets to (line, column) and back. Every line counts one byte for its
+// newline; searches can count wider line endings (CRLF) on top. A second tree tracks UTF-8
+// codepoints.
+// Columns inside a line convert between codepoints and bytes without decoding it: directly on
+// ASCII lines (equal counts in both trees), through a short scan on short lines, and through a
+// Utf8Columns table built on first use for long non-ASCII lines.
+class LineOffsetIndex {
+private:
+    FenwickTree bytes;
+    FenwickTree codepoints;
+    mutable std::unordered_map<size_t, Utf8Columns> columns;
+    bool valid;
+
+    static const size_t kColumnTableBytes = 256;
+
+    const Utf8Columns* columnTable(size_t index, LineView line) const {
+        if (line.size < kColumnTableBytes || isAsciiLine(index)) {
+            return nullptr;
+        }
+        std::unordered_map<size_t, Utf8Columns>::iterator table = columns.find(index);
+        if (table == columns.end()) {
+            table = columns.insert(std::make_pair(index, Utf8Columns(line))).first;
+        }
+        return &table->second;
+    }
+
+public:
+    LineOffsetIndex() : valid(false) {}
+
+    bool isValid() const {
+        return valid;
+    }
+
+    void invalidate() {
+        valid = false;
+        bytes.clear();
+        codepoints.clear();
+        columns.clear();
+    }
+
+    template <typename Store>
+    void rebuild(const Store& store) {
+        std::vector<uint64_t> byteCounts(store.size());
+        std::vector<uint64_t> codepointCounts(store.size());
+        for (size_t i = 0; i < store.size(); i++) {
+            LineView line = store.line(i);
+            byteCounts[i] = line.size + 1;
+            codepointCounts[i] = countCodepoints(line.data, line.size) + 1;
+        }
+        bytes.build(byteCounts);
+        codepoints.build(codepointCounts);
+        columns.clear();
+        valid = true;
+    }
+
+    void update(size_t index, LineView line) {
+        if (valid) {
+            bytes.set(index, line.size + 1);
+            codepoints.set(index, countCodepoints(line.data, line.size) + 1);
+            columns.erase(index);
+        }
+    }
+
+    void append(LineView line) {
+        if (valid) {
+            bytes.append(line.size + 1);
+            codepoints.append(countCodepoints(line.data, line.size) + 1);
+        }
+    }
+
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage = bytes.memoryUsage();
+        usage += codepoints.memoryUsage();
+        for (const std::pair<const size_t, Utf8Columns>& table : columns) {
+            // One hash node per table: key, value and the next pointer.
+            usage.addBlock(sizeof(table) + sizeof(void*), sizeof(table) + sizeof(void*));
+            usage += table.second.memoryUsage();
+        }
+        usage.addBlock(columns.bucket_count() * sizeof(void*), columns.bucket_count() * sizeof(void*));
+        return usage;
+    }
+
+    uint64_t totalBytes() const {
+        return bytes.total();
+    }
+
+    uint64_t totalCodepoints() const {
+        return codepoints.total();
+    }
+
+    uint64_t lineStartByte(size_t index) const {
+        return bytes.prefix(index);
+    }
+
+    uint64_t lineStartCodepoint(size_t index) const {
+        return codepoints.prefix(index);
+    }
+
+    // Line index (0-based) containing the byte at `offset`, and the column inside it, with
+    // every line break counting `extraNewlineBytes` more than one byte.
+    size_t lineAtByte(uint64_t offset, uint64_t& column, uint64_t extraNewlineBytes = 0) const {
+        return bytes.search(offset, column, extraNewlineBytes);
+    }
+
+    size_t lineAtCodepoint(uint64_t offset, uint64_t& column) const {
+        return codepoints.search(offset, column);
+    }
+
+    uint64_t lineCodepoints(size_t index) const {
+        return codepoints.value(index) - 1;
+    }
+
+    bool isAsciiLine(size_t index) const {
+        return bytes.value(index) == codepoints.value(index);
+    }
+
+    // Byte column of codepoint `column` of line `index` (whose current text is `line`): line.size
+    // for the end of the line, npos past it.
+    size_t byteColumn(size_t index, LineView line, uint64_t column) const {
+        if (isAsciiLine(index)) {
+            return column <= line.size ? static_cast<size_t>(column) : std::string::npos;
+        }
+        const Utf8Columns* table = columnTable(index, line);
+        return table ? table->byteColumn(line, column) : advanceCodepoints(line.data, line.size, 0, column);
+    }
+
+    // Codepoints of line `index` before byte `position`.
+    uint64_t codepointColumn(size_t index, LineView line, size_t position) const {
+        if (isAsciiLine(index)) {
+            return position;
+        }
+        const Utf8Columns* table = columnTable(index, line);
+        return table ? table->codepointColumn(line, position) : countCodepoints(line.data, position);
+    }
+};
+
+#endif //HM2PP_LINE_OFFSET_INDEX_H
@@ -0,0 +1,94 @@
+#ifndef HM2PP_LINE_RANGE_H
+#define HM2PP_LINE_RANGE_H
+
+#include <cstddef>
+#include <iterator>
+
+#include "LineView.h"
+
+// Non-owning view of lines [first, last) of a line store or snapshot. Iterating yields
+// LineViews, so a range-for walks a document without copying it. The range has size() and
+// line(i) itself, so it can be handed to anything that takes a store (FilesSL, SearchFunctions)
+// to work on part of a document. Valid until the store is modified.
+template <typename Lines>
+class LineRange {
+private:
+    const Lines* lines;
+    size_t first;
+    size_t last;
+
+public:
+    class iterator {
+    private:
+        const Lines* lines;
+        size_t index;
+
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef LineView value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const LineView* pointer;
+        typedef LineView reference;
+
+        iterator(const Lines* lines, size_t index) : lines(lines), index(index) {}
+
+        LineView operator*() const {
+            return lines->line(index);
+        }
+
+        iterator& operator++() {
+            index++;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator previous = *this;
+            index++;
+            return previous;
+        }
+
+        bool operator==(const iterator& other) const {
+            return index == other.index;
+        }
+
+        bool operator!=(const iterator& other) const {
+            return index != other.index;
+        }
+
+        // 0-based index of the line in the whole store.
+        size_t lineIndex() const {
+            return index;
+        }
+    };
+
+    LineRange(const Lines& lines, size_t first, size_t last) : lines(&lines), first(first), last(last) {}
+
+    explicit LineRange(const Lines& lines) : lines(&lines), first(0), last(lines.size()) {}
+
+    iterator begin() const {
+        return iterator(lines, first);
+    }
+
+    iterator end() const {
+        return iterator(lines, last);
+    }
+
+    size_t size() const {
+        return last - first;
+    }
+
+    bool empty() const {
+        return first == last;
+    }
+
+    // Line `index` of the range, not of the store.
+    LineView line(size_t index) const {
+        return lines->line(first + index);
+    }
+
+    LineView operator[](size_t index) const {
+        return line(index);
+    }
+};
+
+#endif //HM2PP_LINE_RANGE_H
@@ -0,0 +1,50 @@
+#ifndef HM2PP_LINE_VIEW_H
+#define HM2PP_LINE_VIEW_H
+
+#include <cstring>
+#include <ostream>
+#include <string>
+
+// Non-owning reference to the text of one line. Stays valid until the line store is modified.
+struct LineView {
+    const char* data;
+    size_t size;
+
+    LineView() : data(""), size(0) {}
+
+    LineView(const char* data, size_t size) : data(data), size(size) {}
+
+    LineView(const std::string& line) : data(line.data()), size(line.size()) {}
+
+    std::string str() const {
+        return std::string(data, size);
+    }
+
+    std::string substr(size_t position, size_t length) const {
+        return std::string(data + position, length);
+    }
+
+    size_t find(const std::string& needle) const {
+        if (needle.empty()) {
+            return 0;
+        }
+        if (needle.size() > size) {
+            return std::string::npos;
+        }
+        const char* last = data + size - needle.size() + 1;
+        const char* candidate = data;
+        while ((candidate = static_cast<const char*>(std::memchr(candidate, needle[0], last - candidate))) != nullptr) {
+            if (std::memcmp(candidate, needle.data(), needle.size()) == 0) {
+                return candidate - data;
+            }
+            candidate++;
+        }
+        return std::string::npos;
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const LineView& line) {
+    return out.write(line.data, line.size);
+}
+
+#endif //HM2PP_LINE_VIEW_H
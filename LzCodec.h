@@ -0,0 +1,160 @@
+#ifndef HM2PP_LZ_CODEC_H
+#define HM2PP_LZ_CODEC_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Varint.h"
+
+// Byte-oriented LZ77 codec in the style of LZ4: greedy matching through a hash of the next
+// four bytes, a 64KB window, no entropy coding. Compresses text by 2-4x at hundreds of MB/s,
+// which is what cold undo history needs.
+//
+// Stream: varint raw size, then sequences of
+//   token (literal count << 4 | match length - 4), extra literal count bytes, literals,
+//   2-byte little-endian match offset, extra match length bytes
+// where a 15 in either half of the token continues in bytes of 255 until a smaller one.
+// The last sequence has literals only.
+class LzCodec {
+private:
+    static const size_t kMinMatch = 4;
+    static const size_t kMaxOffset = 65535;
+    static const int kHashBits = 14;
+
+    static uint32_t hashAt(const char* position) {
+        uint32_t word;
+        std::memcpy(&word, position, 4);
+        return (word * 2654435761U) >> (32 - kHashBits);
+    }
+
+    static void appendLength(std::string& out, size_t length) {
+        while (length >= 255) {
+            out.push_back(static_cast<char>(255));
+            length -= 255;
+        }
+        out.push_back(static_cast<char>(length));
+    }
+
+    static void appendSequence(std::string& out, const char* literals, size_t literalCount, size_t offset,
+                               size_t matchLength) {
+        size_t matchCode = matchLength ? matchLength - kMinMatch : 0;
+        out.push_back(static_cast<char>((literalCount < 15 ? literalCount : 15) << 4 |
+                                        (matchCode < 15 ? matchCode : 15)));
+        if (literalCount >= 15) {
+            appendLength(out, literalCount - 15);
+        }
+        out.append(literals, literalCount);
+        if (matchLength == 0) {
+            return;
+        }
+        out.push_back(static_cast<char>(offset & 0xFF));
+        out.push_back(static_cast<char>(offset >> 8));
+        if (matchCode >= 15) {
+            appendLength(out, matchCode - 15);
+        }
+    }
+
+    static bool readLength(const char*& cursor, const char* end, size_t& length) {
+        unsigned char byte;
+        do {
+            if (cursor == end) {
+                return false;
+            }
+            byte = static_cast<unsigned char>(*cursor++);
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+public:
+    static void compress(const char* data, size_t size, std::string& out) {
+        out.clear();
+        appendVarint(out, size);
+        out.reserve(out.size() + size / 2 + 16);
+
+        std::vector<uint32_t> table(static_cast<size_t>(1) << kHashBits, 0);
+        size_t anchor = 0;
+        size_t i = 0;
+        size_t misses = 0;
+        while (i + kMinMatch <= size) {
+            uint32_t hash = hashAt(data + i);
+            size_t candidate = table[hash];
+            table[hash] = static_cast<uint32_t>(i);
+            if (candidate >= i || i - candidate > kMaxOffset || std::memcmp(data + candidate, data + i, kMinMatch) != 0) {
+                // Step faster through data that keeps failing to match.
+                i += 1 + (misses++ >> 5);
+                continue;
+            }
+            misses = 0;
+            size_t length = kMinMatch;
+            while (i + length + 8 <= size && std::memcmp(data + candidate + length, data + i + length, 8) == 0) {
+                length += 8;
+            }
+            while (i + length < size && data[candidate + length] == data[i + length]) {
+                length++;
+            }
+            appendSequence(out, data + anchor, i - anchor, i - candidate, length);
+            i += length;
+            anchor = i;
+        }
+        appendSequence(out, data + anchor, size - anchor, 0, 0);
+    }
+
+    // Returns false for a stream that is not well formed; `out` is then unspecified.
+    static bool decompress(const char* data, size_t size, std::string& out) {
+        const char* cursor = data;
+        const char* end = data + size;
+        uint64_t rawSize;
+        if (!readVarint(cursor, end, rawSize) || rawSize / 256 > size) {
+            return false;
+        }
+        out.resize(rawSize);
+        char* target = &out[0];
+        size_t written = 0;
+        while (cursor < end) {
+            unsigned char token = static_cast<unsigned char>(*cursor++);
+            size_t literalCount = token >> 4;
+            if (literalCount == 15 && !readLength(cursor, end, literalCount)) {
+                return false;
+            }
+            if (static_cast<size_t>(end - cursor) < literalCount || rawSize - written < literalCount) {
+                return false;
+            }
+            std::memcpy(target + written, cursor, literalCount);
+            cursor += literalCount;
+            written += literalCount;
+            if (cursor == end) {
+                break;
+            }
+
+            if (end - cursor < 2) {
+                return false;
+            }
+            size_t offset = static_cast<unsigned char>(cursor[0]) | static_cast<unsigned char>(cursor[1]) << 8;
+            cursor += 2;
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !readLength(cursor, end, matchLength)) {
+                return false;
+            }
+            matchLength += kMinMatch;
+            if (offset == 0 || offset > written || rawSize - written < matchLength) {
+                return false;
+            }
+            const char* source = target + written - offset;
+            if (offset >= matchLength) {
+                std::memcpy(target + written, source, matchLength);
+            } else {
+                // The match overlaps the bytes it produces (a run), so copy byte by byte.
+                for (size_t k = 0; k < matchLength; k++) {
+                    target[written + k] = source[k];
+                }
+            }
+            written += matchLength;
+        }
+        return written == rawSize;
+    }
+};
+
+#endif //HM2PP_LZ_CODEC_H
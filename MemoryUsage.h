@@ -0,0 +1,64 @@
+#ifndef HM2PP_MEMORY_USAGE_H
+#define HM2PP_MEMORY_USAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Heap footprint of a data structure. `live` counts bytes holding data, `allocated` what was
+// requested from the allocator (live plus spare capacity), and `overhead` the estimated malloc
+// bookkeeping and rounding on top of that.
+struct MemoryUsage {
+    uint64_t live;
+    uint64_t allocated;
+    uint64_t overhead;
+    uint64_t blocks;
+
+    MemoryUsage() : live(0), allocated(0), overhead(0), blocks(0) {}
+
+    // Estimate for a glibc-style malloc: 8-byte chunk header, 16-byte granularity, 32-byte minimum.
+    static uint64_t allocatorOverhead(uint64_t requested) {
+        uint64_t chunk = (requested + 8 + 15) & ~uint64_t(15);
+        if (chunk < 32) {
+            chunk = 32;
+        }
+        return chunk - requested;
+    }
+
+    void addBlock(uint64_t liveBytes, uint64_t requested) {
+        if (requested == 0) {
+            return;
+        }
+        live += liveBytes;
+        allocated += requested;
+        overhead += allocatorOverhead(requested);
+        blocks++;
+    }
+
+    template <typename T, typename Allocator>
+    void addVector(const std::vector<T, Allocator>& values) {
+        addBlock(values.size() * sizeof(T), values.capacity() * sizeof(T));
+    }
+
+    // Counts only the heap buffer; the std::string object itself lives in its container.
+    void addString(const std::string& text) {
+        static const size_t inlineCapacity = std::string().capacity();
+        if (text.capacity() > inlineCapacity) {
+            addBlock(text.size() + 1, text.capacity() + 1);
+        }
+    }
+
+    uint64_t total() const {
+        return allocated + overhead;
+    }
+
+    MemoryUsage& operator+=(const MemoryUsage& other) {
+        live += other.live;
+        allocated += other.allocated;
+        overhead += other.overhead;
+        blocks += other.blocks;
+        return *this;
+    }
+};
+
+#endif //HM2PP_MEMORY_USAGE_H
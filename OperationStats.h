@@ -0,0 +1,224 @@
+#ifndef HM2PP_OPERATION_STATS_H
+#define HM2PP_OPERATION_STATS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <string>
+
+#include "AllocationCounter.h"
+#include "ChromeTrace.h"
+
+// HDR-style latency histogram: exact buckets below 64 ns, then 32 linear sub-buckets per power
+// of two, so any recorded value is reported within about 3% and recording is O(1).
+class LatencyHistogram {
+private:
+    static const int kSubBucketBits = 5;
+    static const size_t kSubBucketCount = size_t(1) << kSubBucketBits;
+    static const size_t kBucketCount = (65 - kSubBucketBits) * kSubBucketCount;
+
+    uint64_t counts[kBucketCount];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t minimum;
+    uint64_t maximum;
+
+    static int highestBit(uint64_t value) {
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(value);
+#else
+        int bit = 0;
+        while (value >>= 1) {
+            bit++;
+        }
+        return bit;
+#endif
+    }
+
+    static size_t bucketOf(uint64_t value) {
+        if (value < 2 * kSubBucketCount) {
+            return static_cast<size_t>(value);
+        }
+        int shift = highestBit(value) - kSubBucketBits;
+        return shift * kSubBucketCount + static_cast<size_t>(value >> shift);
+    }
+
+    static uint64_t bucketUpperBound(size_t bucket) {
+        if (bucket < 2 * kSubBucketCount) {
+            return bucket;
+        }
+        size_t shift = bucket / kSubBucketCount - 1;
+        uint64_t subBucket = bucket - shift * kSubBucketCount;
+        return ((subBucket + 1) << shift) - 1;
+    }
+
+public:
+    LatencyHistogram() {
+        reset();
+    }
+
+    void reset() {
+        std::fill(counts, counts + kBucketCount, 0);
+        total = 0;
+        sum = 0;
+        minimum = 0;
+        maximum = 0;
+    }
+
+    void record(uint64_t value) {
+        counts[bucketOf(value)]++;
+        minimum = total == 0 || value < minimum ? value : minimum;
+        maximum = value > maximum ? value : maximum;
+        total++;
+        sum += value;
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    uint64_t min() const {
+        return minimum;
+    }
+
+    uint64_t max() const {
+        return maximum;
+    }
+
+    double mean() const {
+        return total ? static_cast<double>(sum) / total : 0;
+    }
+
+    // Value at or below which `fraction` of the recorded values fall.
+    uint64_t percentile(double fraction) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(fraction * total + 0.5);
+        rank = rank == 0 ? 1 : rank;
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < kBucketCount; bucket++) {
+            seen += counts[bucket];
+            if (seen >= rank) {
+                uint64_t bound = bucketUpperBound(bucket);
+                return bound < maximum ? bound : maximum;
+            }
+        }
+        return maximum;
+    }
+};
+
+struct OperationStats {
+    std::string name;
+    LatencyHistogram latency;
+    uint64_t calls;
+    uint64_t bytes;
+    uint64_t allocations;
+
+    OperationStats() : calls(0), bytes(0), allocations(0) {}
+};
+
+// Process-wide table of per-operation statistics, listed by the `stats` command.
+class StatsRegistry {
+private:
+    std::map<std::string, OperationStats> operations;
+
+    static StatsRegistry& instance() {
+        static StatsRegistry registry;
+        return registry;
+    }
+
+public:
+    // References stay valid for the life of the process, so callers can cache them.
+    static OperationStats& operation(const std::string& name) {
+        OperationStats& stats = instance().operations[name];
+        stats.name = name;
+        return stats;
+    }
+
+    static void reset() {
+        for (std::map<std::string, OperationStats>::iterator it = instance().operations.begin();
+             it != instance().operations.end(); ++it) {
+            it->second = OperationStats();
+            it->second.name = it->first;
+        }
+    }
+
+    static void printTable(std::ostream& out) {
+        out << std::left << std::setw(42) << "operation" << std::right << std::setw(10) << "calls"
+            << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns" << std::setw(12) << "max ns"
+            << std::setw(12) << "mean ns" << std::setw(14) << "bytes" << std::setw(12) << "allocs" << std::endl;
+        for (std::map<std::string, OperationStats>::const_iterator it = instance().operations.begin();
+             it != instance().operations.end(); ++it) {
+            const OperationStats& stats = it->second;
+            if (stats.calls == 0) {
+                continue;
+            }
+            out << std::left << std::setw(42) << it->first << std::right << std::setw(10) << stats.calls
+                << std::setw(12) << stats.latency.percentile(0.5) << std::setw(12) << stats.latency.percentile(0.99)
+                << std::setw(12) << stats.latency.max() << std::setw(12) << std::fixed << std::setprecision(0)
+                << stats.latency.mean() << std::setw(14) << stats.bytes << std::setw(12) << stats.allocations
+                << std::endl;
+        }
+    }
+
+    static void writeJson(std::ostream& out) {
+        out << "{\"operations\":{";
+        bool first = true;
+        for (std::map<std::string, OperationStats>::const_iterator it = instance().operations.begin();
+             it != instance().operations.end(); ++it) {
+            const OperationStats& stats = it->second;
+            if (stats.calls == 0) {
+                continue;
+            }
+            out << (first ? "" : ",") << "\"" << it->first << "\":{\"calls\":" << stats.calls
+                << ",\"bytes\":" << stats.bytes << ",\"allocations\":" << stats.allocations
+                << ",\"latency_ns\":{\"min\":" << stats.latency.min()
+                << ",\"mean\":" << std::fixed << std::setprecision(1) << stats.latency.mean()
+                << ",\"p50\":" << stats.latency.percentile(0.5) << ",\"p90\":" << stats.latency.percentile(0.9)
+                << ",\"p99\":" << stats.latency.percentile(0.99) << ",\"p999\":" << stats.latency.percentile(0.999)
+                << ",\"max\":" << stats.latency.max() << "}}";
+            first = false;
+        }
+        out << "}}" << std::endl;
+    }
+};
+
+// Times one call of an operation and records latency, bytes touched and heap allocations.
+// When Chrome tracing is on, the call is also emitted as a trace span.
+class ScopedOperation {
+private:
+    OperationStats& stats;
+    std::chrono::steady_clock::time_point start;
+    uint64_t startAllocations;
+    uint64_t bytes;
+
+public:
+    explicit ScopedOperation(OperationStats& stats)
+        : stats(stats), start(std::chrono::steady_clock::now()),
+          startAllocations(AllocationCounter::allocations()), bytes(0) {}
+
+    ScopedOperation(const ScopedOperation&) = delete;
+    ScopedOperation& operator=(const ScopedOperation&) = delete;
+
+    void addBytes(uint64_t count) {
+        bytes += count;
+    }
+
+    ~ScopedOperation() {
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        if (ChromeTrace::enabled()) {
+            ChromeTrace::complete(stats.name, "operation", start, end, bytes);
+        }
+        stats.calls++;
+        stats.bytes += bytes;
+        stats.allocations += AllocationCounter::allocations() - startAllocations;
+        stats.latency.record(elapsed);
+    }
+};
+
+#endif //HM2PP_OPERATION_STATS_H
@@ -0,0 +1,108 @@
+#ifndef HM2PP_PACKED_LINES_H
+#define HM2PP_PACKED_LINES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LineView.h"
+#include "LzCodec.h"
+#include "MemoryUsage.h"
+#include "Varint.h"
+
+// Lines held as views, either into `text` (unpacked history) or into memory owned elsewhere.
+struct LineViewList {
+    std::string text;
+    std::vector<LineView> views;
+
+    size_t size() const {
+        return views.size();
+    }
+
+    LineView line(size_t index) const {
+        return views[index];
+    }
+};
+
+// A document flattened into one buffer (varint line count, varint line lengths, then all the
+// text) and LZ-compressed. Used for undo-history entries that have gone cold.
+class PackedLines {
+private:
+    std::string packed;
+
+public:
+    template <typename Lines>
+    void pack(const Lines& lines) {
+        std::string raw;
+        size_t textBytes = 0;
+        for (size_t i = 0; i < lines.size(); i++) {
+            textBytes += lines.line(i).size;
+        }
+        raw.reserve(textBytes + lines.size() * 2 + 10);
+        appendVarint(raw, lines.size());
+        for (size_t i = 0; i < lines.size(); i++) {
+            appendVarint(raw, lines.line(i).size);
+        }
+        for (size_t i = 0; i < lines.size(); i++) {
+            LineView line = lines.line(i);
+            raw.append(line.data, line.size);
+        }
+        LzCodec::compress(raw.data(), raw.size(), packed);
+        packed.shrink_to_fit();
+    }
+
+    // Decompresses into `lines.text` and points `lines.views` into it.
+    bool unpack(LineViewList& lines) const {
+        lines.views.clear();
+        if (!LzCodec::decompress(packed.data(), packed.size(), lines.text)) {
+            return false;
+        }
+        const char* cursor = lines.text.data();
+        const char* end = cursor + lines.text.size();
+        uint64_t count;
+        if (!readVarint(cursor, end, count) || count > lines.text.size()) {
+            return false;
+        }
+        lines.views.resize(count);
+        for (uint64_t i = 0; i < count; i++) {
+            uint64_t size;
+            if (!readVarint(cursor, end, size)) {
+                return false;
+            }
+            lines.views[i].size = size;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            if (static_cast<uint64_t>(end - cursor) < lines.views[i].size) {
+                return false;
+            }
+            lines.views[i].data = cursor;
+            cursor += lines.views[i].size;
+        }
+        return true;
+    }
+
+    // The compressed bytes, for keeping a packed document outside memory (journal checkpoints).
+    const std::string& bytes() const {
+        return packed;
+    }
+
+    void assign(const char* data, size_t size) {
+        packed.assign(data, size);
+    }
+
+    bool empty() const {
+        return packed.empty();
+    }
+
+    void clear() {
+        std::string().swap(packed);
+    }
+
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addString(packed);
+        return usage;
+    }
+};
+
+#endif //HM2PP_PACKED_LINES_H
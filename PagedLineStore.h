@@ -0,0 +1,534 @@
+#ifndef HM2PP_PAGED_LINE_STORE_H
+#define HM2PP_PAGED_LINE_STORE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "LineView.h"
+#include "MemoryUsage.h"
+#include "TextSlice.h"
+#include "Varint.h"
+
+// Where one block of lines lives in the page file. `offset` is kNotWritten while the block
+// exists only in the cache.
+struct PageExtent {
+    static const uint64_t kNotWritten = ~static_cast<uint64_t>(0);
+
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t firstLine;
+    uint64_t textBytes;
+    uint32_t lineCount;
+};
+
+// Append-only scratch file (deleted on close) that holds line blocks for PagedLineStore. A
+// written block never changes, so a store and all of its snapshots share one page file.
+class PageFile {
+private:
+    std::FILE* file;
+    uint64_t end;
+    std::string buffer;
+    uint64_t lastOffset;
+    std::vector<std::string> lastLines;
+
+    void seek(uint64_t offset) {
+#if defined(_WIN32)
+        bool ok = _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+        bool ok = fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+        if (!ok) {
+            throw std::runtime_error("Page file seek failed.");
+        }
+    }
+
+public:
+    PageFile() : file(std::tmpfile()), end(0), lastOffset(PageExtent::kNotWritten) {
+        if (!file) {
+            throw std::runtime_error("Cannot create the page file.");
+        }
+    }
+
+    PageFile(const PageFile&) = delete;
+    PageFile& operator=(const PageFile&) = delete;
+
+    ~PageFile() {
+        std::fclose(file);
+    }
+
+    uint64_t size() const {
+        return end;
+    }
+
+    // Appends a block (varint line count, varint lengths, then the text) and records where.
+    void write(const std::vector<std::string>& lines, PageExtent& extent) {
+        buffer.clear();
+        appendVarint(buffer, lines.size());
+        for (const std::string& line : lines) {
+            appendVarint(buffer, line.size());
+        }
+        for (const std::string& line : lines) {
+            buffer.append(line);
+        }
+        seek(end);
+        if (std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+            throw std::runtime_error("Page file write failed.");
+        }
+        extent.offset = end;
+        extent.bytes = buffer.size();
+        end += buffer.size();
+    }
+
+    void read(const PageExtent& extent, std::vector<std::string>& lines) {
+        buffer.resize(extent.bytes);
+        seek(extent.offset);
+        if (std::fread(&buffer[0], 1, buffer.size(), file) != buffer.size()) {
+            throw std::runtime_error("Page file read failed.");
+        }
+        const char* cursor = buffer.data();
+        const char* limit = cursor + buffer.size();
+        uint64_t count = 0;
+        readVarint(cursor, limit, count);
+        std::vector<uint64_t> lengths(count);
+        for (uint64_t& length : lengths) {
+            readVarint(cursor, limit, length);
+        }
+        lines.resize(count);
+        for (uint64_t i = 0; i < count; i++) {
+            lines[i].assign(cursor, lengths[i]);
+            cursor += lengths[i];
+        }
+    }
+
+    // Like read(), but keeps the last block it read; snapshots walk their lines in order.
+    const std::vector<std::string>& readShared(const PageExtent& extent) {
+        if (extent.offset != lastOffset) {
+            read(extent, lastLines);
+            lastOffset = extent.offset;
+        }
+        return lastLines;
+    }
+};
+
+// Block table split into fixed-size chunks that are copied on write, so a snapshot shares
+// every chunk the edits after it did not touch.
+class PageExtentTable {
+private:
+    static const size_t kChunkSize = 512;
+    typedef std::vector<PageExtent> Chunk;
+
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    size_t count;
+
+public:
+    PageExtentTable() : count(0) {}
+
+    size_t size() const {
+        return count;
+    }
+
+    const PageExtent& operator[](size_t index) const {
+        return (*chunks[index / kChunkSize])[index % kChunkSize];
+    }
+
+    PageExtent& mutableAt(size_t index) {
+        std::shared_ptr<Chunk>& chunk = chunks[index / kChunkSize];
+        if (chunk.use_count() > 1) {
+            chunk = std::make_shared<Chunk>(*chunk);
+        }
+        return (*chunk)[index % kChunkSize];
+    }
+
+    void push_back(const PageExtent& extent) {
+        if (count % kChunkSize == 0) {
+            chunks.push_back(std::make_shared<Chunk>());
+            chunks.back()->reserve(kChunkSize);
+        } else if (chunks.back().use_count() > 1) {
+            chunks.back() = std::make_shared<Chunk>(*chunks.back());
+        }
+        chunks.back()->push_back(extent);
+        count++;
+    }
+
+    void clear() {
+        chunks.clear();
+        count = 0;
+    }
+
+    // Replaces extents [first, first + removed) with `extents` and moves the first line of every
+    // extent after them by `lineShift`. Chunks before `first` stay shared.
+    void splice(size_t first, size_t removed, const std::vector<PageExtent>& extents, int64_t lineShift) {
+        std::vector<PageExtent> tail;
+        tail.reserve(count - first - removed);
+        for (size_t i = first + removed; i < count; i++) {
+            tail.push_back((*this)[i]);
+        }
+        chunks.resize((first + kChunkSize - 1) / kChunkSize);
+        if (first % kChunkSize != 0) {
+            chunks.back() = std::make_shared<Chunk>(chunks.back()->begin(), chunks.back()->begin() + first % kChunkSize);
+        }
+        count = first;
+        for (const PageExtent& extent : extents) {
+            push_back(extent);
+        }
+        for (PageExtent& extent : tail) {
+            extent.firstLine += lineShift;
+            push_back(extent);
+        }
+    }
+
+    // Block holding line `line`; the table must not be empty.
+    size_t blockOf(uint64_t line) const {
+        size_t low = 0;
+        size_t high = count;
+        while (high - low > 1) {
+            size_t middle = (low + high) / 2;
+            if ((*this)[middle].firstLine <= line) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    // Chunks shared with other tables count once, with the table that owns them alone.
+    MemoryUsage memoryUsage(bool includeShared) const {
+        MemoryUsage usage;
+        usage.addVector(chunks);
+        for (const std::shared_ptr<Chunk>& chunk : chunks) {
+            if (includeShared || chunk.use_count() == 1) {
+                usage.addBlock(sizeof(Chunk), sizeof(Chunk) + 16);
+                usage.addVector(*chunk);
+            }
+        }
+        return usage;
+    }
+};
+
+// Line store for documents larger than memory. Lines are grouped into blocks of about
+// kBlockBytes; blocks are written to a scratch page file and at most `cacheBlocks` of them are
+// held in memory, least recently used first out. line(), modify() and push_back() fault blocks
+// in; an evicted block that was edited is appended to the page file again. A snapshot writes
+// out the edited blocks and keeps only the block table, so undo history costs a few bytes per
+// block instead of a copy of the text.
+//
+// A LineView stays valid until the store is modified or cacheBlocks - 1 other blocks have been
+// faulted in since, so any one view can be used across the next call to line().
+class PagedLineStore {
+private:
+    static const uint64_t kBlockBytes = 64 * 1024;
+    static const uint32_t kBlockLines = 4096;
+
+    struct CachedBlock {
+        size_t block;
+        bool dirty;
+        std::vector<std::string> lines;
+    };
+
+    typedef std::list<CachedBlock> Cache;
+
+    std::shared_ptr<PageFile> file;
+    mutable PageExtentTable blocks;
+    size_t lineCount;
+    size_t cacheBlocks;
+    mutable Cache cache;
+    mutable std::unordered_map<size_t, Cache::iterator> cached;
+
+    void evictOne() const {
+        CachedBlock& victim = cache.back();
+        if (victim.dirty) {
+            file->write(victim.lines, blocks.mutableAt(victim.block));
+        }
+        cached.erase(victim.block);
+        cache.pop_back();
+    }
+
+    CachedBlock& insertCached(size_t block) const {
+        while (cache.size() >= cacheBlocks) {
+            evictOne();
+        }
+        cache.push_front(CachedBlock());
+        cache.front().block = block;
+        cache.front().dirty = false;
+        cached[block] = cache.begin();
+        return cache.front();
+    }
+
+    CachedBlock& fault(size_t block) const {
+        std::unordered_map<size_t, Cache::iterator>::iterator found = cached.find(block);
+        if (found != cached.end()) {
+            cache.splice(cache.begin(), cache, found->second);
+            return cache.front();
+        }
+        CachedBlock& entry = insertCached(block);
+        file->read(blocks[block], entry.lines);
+        return entry;
+    }
+
+    void dropCache() {
+        cache.clear();
+        cached.clear();
+    }
+
+    // Writes every edited cached block, so the block table alone describes the document.
+    void flush() const {
+        for (CachedBlock& entry : cache) {
+            if (entry.dirty) {
+                file->write(entry.lines, blocks.mutableAt(entry.block));
+                entry.dirty = false;
+            }
+        }
+    }
+
+public:
+    class Snapshot {
+    private:
+        std::shared_ptr<PageFile> file;
+        PageExtentTable blocks;
+        size_t lineCount;
+
+        friend class PagedLineStore;
+
+    public:
+        Snapshot(const std::shared_ptr<PageFile>& file, const PageExtentTable& blocks, size_t lineCount)
+            : file(file), blocks(blocks), lineCount(lineCount) {}
+
+        size_t size() const {
+            return lineCount;
+        }
+
+        // Reads through the page file's one-block buffer; meant for walking the lines in order.
+        LineView line(size_t index) const {
+            size_t block = blocks.blockOf(index);
+            return file->readShared(blocks[block])[index - blocks[block].firstLine];
+        }
+
+        uint64_t textBytes() const {
+            uint64_t total = 0;
+            for (size_t i = 0; i < blocks.size(); i++) {
+                total += blocks[i].textBytes;
+            }
+            return total;
+        }
+
+        // Only the chunks of the block table no one else shares; the text is on disk.
+        MemoryUsage memoryUsage() const {
+            return blocks.memoryUsage(false);
+        }
+    };
+
+    explicit PagedLineStore(size_t cacheBlocks = 256)
+        : file(std::make_shared<PageFile>()), lineCount(0), cacheBlocks(std::max<size_t>(cacheBlocks, 2)) {}
+
+    PagedLineStore(const PagedLineStore&) = delete;
+    PagedLineStore& operator=(const PagedLineStore&) = delete;
+
+    PagedLineStore(PagedLineStore&& other)
+        : file(other.file), blocks(other.blocks), lineCount(other.lineCount), cacheBlocks(other.cacheBlocks) {
+        cache.swap(other.cache);
+        cached.swap(other.cached);
+        other.blocks.clear();
+        other.lineCount = 0;
+    }
+
+    PagedLineStore& operator=(PagedLineStore&& other) {
+        if (this != &other) {
+            file = other.file;
+            blocks = other.blocks;
+            lineCount = other.lineCount;
+            cacheBlocks = other.cacheBlocks;
+            dropCache();
+            cache.swap(other.cache);
+            cached.swap(other.cached);
+            other.blocks.clear();
+            other.lineCount = 0;
+        }
+        return *this;
+    }
+
+    size_t size() const {
+        return lineCount;
+    }
+
+    LineView line(size_t index) const {
+        size_t block = blocks.blockOf(index);
+        return fault(block).lines[index - blocks[block].firstLine];
+    }
+
+    template <typename Edit>
+    void modify(size_t index, Edit edit) {
+        size_t block = blocks.blockOf(index);
+        CachedBlock& entry = fault(block);
+        std::string& text = entry.lines[index - blocks[block].firstLine];
+        uint64_t oldSize = text.size();
+        edit(text);
+        PageExtent& extent = blocks.mutableAt(block);
+        extent.textBytes = extent.textBytes - oldSize + text.size();
+        extent.offset = PageExtent::kNotWritten;
+        entry.dirty = true;
+    }
+
+    // Cached blocks are edited in place and evicted, so the slice is a private copy.
+    TextSlice share(size_t index, size_t position, size_t length) const {
+        return TextSlice::copy(line(index).data + position, length);
+    }
+
+    void push_back(const char* data, size_t size) {
+        CachedBlock* entry;
+        if (blocks.size() == 0 || blocks[blocks.size() - 1].lineCount >= kBlockLines ||
+            blocks[blocks.size() - 1].textBytes >= kBlockBytes) {
+            PageExtent extent = {PageExtent::kNotWritten, 0, lineCount, 0, 0};
+            blocks.push_back(extent);
+            entry = &insertCached(blocks.size() - 1);
+        } else {
+            entry = &fault(blocks.size() - 1);
+        }
+        entry->lines.emplace_back(data, size);
+        entry->dirty = true;
+        PageExtent& extent = blocks.mutableAt(blocks.size() - 1);
+        extent.offset = PageExtent::kNotWritten;
+        extent.lineCount++;
+        extent.textBytes += size;
+        lineCount++;
+    }
+
+    void push_back(const std::string& line) {
+        push_back(line.data(), line.size());
+    }
+
+    // Replaces lines [first, first + count) with `n` new ones. Only the blocks at the two ends of
+    // the range are read; the lines between them are dropped with their block table entries, and
+    // the block table after the range is renumbered. `data` must not point into the store.
+    void splice(size_t first, size_t count, const LineView* data, size_t n) {
+        flush();
+        dropCache();
+        if (blocks.size() == 0) {
+            for (size_t i = 0; i < n; i++) {
+                push_back(data[i].data, data[i].size);
+            }
+            return;
+        }
+        // Blocks [firstBlock, lastBlock] hold the range; an insertion at the end goes into the
+        // last block.
+        size_t firstBlock = blocks.blockOf(std::min(first, lineCount - 1));
+        size_t lastBlock = count == 0 ? firstBlock : blocks.blockOf(first + count - 1);
+
+        std::vector<std::string> head;
+        std::vector<std::string> tail;
+        file->read(blocks[firstBlock], head);
+        size_t tailStart = first + count - blocks[lastBlock].firstLine;
+        if (lastBlock != firstBlock) {
+            file->read(blocks[lastBlock], tail);
+            tail.erase(tail.begin(), tail.begin() + tailStart);
+        } else {
+            tail.assign(head.begin() + tailStart, head.end());
+        }
+        head.resize(first - blocks[firstBlock].firstLine);
+
+        // Re-block head + data + tail.
+        std::vector<PageExtent> extents;
+        std::vector<std::string> pending;
+        PageExtent extent = {PageExtent::kNotWritten, 0, blocks[firstBlock].firstLine, 0, 0};
+        size_t total = head.size() + n + tail.size();
+        for (size_t i = 0; i < total; i++) {
+            if (i < head.size()) {
+                pending.push_back(std::move(head[i]));
+            } else if (i < head.size() + n) {
+                pending.push_back(data[i - head.size()].str());
+            } else {
+                pending.push_back(std::move(tail[i - head.size() - n]));
+            }
+            extent.textBytes += pending.back().size();
+            if (pending.size() >= kBlockLines || extent.textBytes >= kBlockBytes || i + 1 == total) {
+                extent.lineCount = static_cast<uint32_t>(pending.size());
+                file->write(pending, extent);
+                extents.push_back(extent);
+                extent.firstLine += pending.size();
+                extent.textBytes = 0;
+                pending.clear();
+            }
+        }
+        blocks.splice(firstBlock, lastBlock - firstBlock + 1, extents,
+                      static_cast<int64_t>(n) - static_cast<int64_t>(count));
+        lineCount = lineCount - count + n;
+    }
+
+    void assign(const std::vector<std::string>& data) {
+        dropCache();
+        blocks.clear();
+        lineCount = 0;
+        for (const std::string& line : data) {
+            push_back(line);
+        }
+    }
+
+    void assign(const LineView* data, size_t count) {
+        dropCache();
+        blocks.clear();
+        lineCount = 0;
+        for (size_t i = 0; i < count; i++) {
+            push_back(data[i].data, data[i].size);
+        }
+    }
+
+    std::vector<std::string> toVector() const {
+        std::vector<std::string> result;
+        result.reserve(lineCount);
+        for (size_t i = 0; i < lineCount; i++) {
+            result.push_back(line(i).str());
+        }
+        return result;
+    }
+
+    // Copies the lines out and empties the store; its text is not kept as std::strings.
+    std::vector<std::string> release() {
+        std::vector<std::string> result = toVector();
+        assign(std::vector<std::string>());
+        return result;
+    }
+
+    Snapshot snapshot() const {
+        flush();
+        return Snapshot(file, blocks, lineCount);
+    }
+
+    void restore(const Snapshot& snapshot) {
+        dropCache();
+        file = snapshot.file;
+        blocks = snapshot.blocks;
+        lineCount = snapshot.lineCount;
+    }
+
+    size_t blockCount() const {
+        return blocks.size();
+    }
+
+    uint64_t pageFileBytes() const {
+        return file->size();
+    }
+
+    // The block table and the cached blocks; text that is only in the page file is not counted.
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage = blocks.memoryUsage(true);
+        for (const CachedBlock& entry : cache) {
+            usage.addBlock(sizeof(CachedBlock), sizeof(CachedBlock) + 2 * sizeof(void*));
+            usage.addVector(entry.lines);
+            for (const std::string& line : entry.lines) {
+                usage.addString(line);
+            }
+        }
+        usage.addBlock(cached.size() * (sizeof(size_t) + sizeof(Cache::iterator)),
+                       cached.bucket_count() * sizeof(void*) + cached.size() * 32);
+        return usage;
+    }
+};
+
+#endif //HM2PP_PAGED_LINE_STORE_H
@@ -0,0 +1,34 @@
+#ifndef HM2PP_SEARCH_FUNCTIONS_H
+#define HM2PP_SEARCH_FUNCTIONS_H
+
+#include <iostream>
+#include <string>
+
+#include "LineView.h"
+#include "OperationStats.h"
+
+class SearchFunctions {
+public:
+    template <typename Lines>
+    static void searchSubstringInArray(const Lines& array, const std::string& substring) {
+        static OperationStats& stats = StatsRegistry::operation("SearchFunctions::searchSubstringInArray");
+        ScopedOperation timer(stats);
+        int foundCount = 0;
+
+        for (size_t i = 0; i < array.size(); i++) {
+            LineView line = array.line(i);
+            timer.addBytes(line.size);
+            size_t found = line.find(substring);
+            if (found != std::string::npos) {
+                std::cout << "Substring found in line " << i + 1 << " at position " << found << ": " << substring << std::endl;
+                foundCount++;
+            }
+        }
+
+        if (foundCount == 0) {
+            std::cout << "Substring not found in any line." << std::endl;
+        }
+    }
+};
+
+#endif //HM2PP_SEARCH_FUNCTIONS_H
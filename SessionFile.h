@@ -0,0 +1,449 @@
+#ifndef HM2PP_SESSION_FILE_H
+#define HM2PP_SESSION_FILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Hashing.h"
+#include "LineView.h"
+#include "OperationStats.h"
+#include "TextEncoding.h"
+
+// Read-only view of a whole file: mapped where mmap is available, read into memory otherwise.
+class MappedFile {
+private:
+    const char* bytes;
+    size_t length;
+#if defined(_WIN32)
+    std::string buffer;
+#else
+    void* mapping;
+#endif
+
+public:
+    MappedFile() : bytes(nullptr), length(0) {
+#if !defined(_WIN32)
+        mapping = nullptr;
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const std::string& fileName) {
+        close();
+#if defined(_WIN32)
+        std::ifstream in(fileName, std::ios::binary);
+        if (!in.is_open()) {
+            return false;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        bytes = buffer.data();
+        length = buffer.size();
+        return true;
+#else
+        int descriptor = ::open(fileName.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(descriptor, &info) != 0) {
+            ::close(descriptor);
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length != 0) {
+            mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (mapping == MAP_FAILED) {
+                mapping = nullptr;
+                length = 0;
+                ::close(descriptor);
+                return false;
+            }
+            bytes = static_cast<const char*>(mapping);
+        }
+        ::close(descriptor);
+        return true;
+#endif
+    }
+
+    void close() {
+#if defined(_WIN32)
+        buffer.clear();
+#else
+        if (mapping) {
+            munmap(mapping, length);
+            mapping = nullptr;
+        }
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const char* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+};
+
+// Fixed header of a session file. All integers are native-endian; sessions are meant to be
+// reopened on the machine that wrote them.
+struct SessionHeader {
+    char magic[8];
+    uint64_t lineCount;
+    uint64_t referenceCount;
+    uint64_t snapshotCount;
+    uint64_t versionCount;
+    uint64_t currentVersion;
+    uint64_t detached;
+    uint64_t encoding;
+    uint64_t lineEnding;
+    uint64_t byteOrderMark;
+    uint64_t finalNewline;
+    uint64_t textBytes;
+    uint64_t clipboardBytes;
+    uint64_t checksum;
+
+    static const char* expectedMagic() {
+        return "HM2PPS4\n";
+    }
+
+    // Parent of the root version, or redo child of a version without one.
+    static const uint64_t kNoVersion = ~static_cast<uint64_t>(0);
+};
+
+// Session layout after the header, every section padded to 8 bytes:
+//   line table   lineCount x {offset into text, size}     uint64 pairs
+//   snapshots    snapshotCount + 1 start indices into the reference list
+//   versions     versionCount x {parent, redo child}       uint64 pairs
+//   references   referenceCount line numbers               uint32
+//   text         each distinct line once
+//   clipboard    registers as written by ClipboardRing::encode
+// Snapshot 0 is the document, then one per undo tree version, parents before children, with
+// version 0 the root. `detached` is set when the document is not the current version (it was
+// replaced outside the history). `encoding` through `finalNewline` are the TextFormat the
+// document saves in. Identical lines are stored once, so a long history of small edits costs
+// mostly references.
+class SessionWriter {
+private:
+    std::vector<uint64_t> lineTable;
+    std::vector<uint64_t> snapshotStarts;
+    std::vector<uint32_t> references;
+    std::string text;
+    std::vector<uint32_t> slots;
+    size_t previousStart;
+
+    static size_t padded(size_t size) {
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+
+    void grow() {
+        std::vector<uint32_t> old;
+        old.swap(slots);
+        slots.assign(old.empty() ? 1024 : old.size() * 2, 0);
+        for (uint32_t slot : old) {
+            if (slot != 0) {
+                const uint64_t* entry = &lineTable[2 * (slot - 1)];
+                insertSlot(hashBytes(text.data() + entry[0], entry[1]), slot);
+            }
+        }
+    }
+
+    size_t insertSlot(uint64_t hash, uint32_t slot) {
+        size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        while (slots[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+        return i;
+    }
+
+    uint32_t lineNumber(LineView line) {
+        if ((lineTable.size() / 2 + 1) * 2 > slots.size()) {
+            grow();
+        }
+        uint64_t hash = hashBytes(line.data, line.size);
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask; slots[i] != 0; i = (i + 1) & mask) {
+            const uint64_t* entry = &lineTable[2 * (slots[i] - 1)];
+            if (entry[1] == line.size && std::memcmp(text.data() + entry[0], line.data, line.size) == 0) {
+                return slots[i] - 1;
+            }
+        }
+        if (lineTable.size() / 2 >= std::numeric_limits<uint32_t>::max() - 1) {
+            throw std::length_error("Too many distinct lines for a session file.");
+        }
+        uint32_t number = static_cast<uint32_t>(lineTable.size() / 2);
+        lineTable.push_back(text.size());
+        lineTable.push_back(line.size);
+        text.append(line.data, line.size);
+        insertSlot(hash, number + 1);
+        return number;
+    }
+
+    template <typename T>
+    static void appendSection(std::string& out, const std::vector<T>& values) {
+        out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+        out.resize(padded(out.size()), '\0');
+    }
+
+public:
+    SessionWriter() : previousStart(0) {
+        snapshotStarts.push_back(0);
+    }
+
+    // Adds the next snapshot; `lines` needs size() and line(i). Successive history entries
+    // differ in a few lines, so each line is first compared with the one at the same index of
+    // the previous snapshot and only hashed when that differs.
+    template <typename Lines>
+    void addSnapshot(const Lines& lines) {
+        size_t start = references.size();
+        size_t previousSize = start - previousStart;
+        for (size_t i = 0; i < lines.size(); i++) {
+            LineView line = lines.line(i);
+            if (i < previousSize) {
+                uint32_t previous = references[previousStart + i];
+                const uint64_t* entry = &lineTable[2 * previous];
+                if (entry[1] == line.size && std::memcmp(text.data() + entry[0], line.data, line.size) == 0) {
+                    references.push_back(previous);
+                    continue;
+                }
+            }
+            references.push_back(lineNumber(line));
+        }
+        previousStart = start;
+        snapshotStarts.push_back(references.size());
+    }
+
+    // `versionLinks` holds the parent and redo child of each version in turn.
+    bool write(const std::string& fileName, const std::vector<uint64_t>& versionLinks, uint64_t currentVersion,
+               bool detached, const TextFormat& format, const std::string& clipboard) {
+        static OperationStats& stats = StatsRegistry::operation("SessionWriter::write");
+        ScopedOperation timer(stats);
+        SessionHeader header;
+        std::memcpy(header.magic, SessionHeader::expectedMagic(), 8);
+        header.lineCount = lineTable.size() / 2;
+        header.referenceCount = references.size();
+        header.snapshotCount = snapshotStarts.size() - 1;
+        header.versionCount = versionLinks.size() / 2;
+        header.currentVersion = currentVersion;
+        header.detached = detached ? 1 : 0;
+        header.encoding = format.encoding;
+        header.lineEnding = format.lineEnding;
+        header.byteOrderMark = format.byteOrderMark ? 1 : 0;
+        header.finalNewline = format.finalNewline ? 1 : 0;
+        header.textBytes = text.size();
+        header.clipboardBytes = clipboard.size();
+
+        std::string body;
+        body.reserve(padded(lineTable.size() * 8) + padded(snapshotStarts.size() * 8) + versionLinks.size() * 8 +
+                     padded(references.size() * 4) + padded(text.size()) + padded(clipboard.size()));
+        appendSection(body, lineTable);
+        appendSection(body, snapshotStarts);
+        appendSection(body, versionLinks);
+        appendSection(body, references);
+        body.append(text);
+        body.resize(padded(body.size()), '\0');
+        body.append(clipboard);
+        header.checksum = hashBytes(body.data(), body.size());
+
+        std::ofstream file(fileName, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error opening the file." << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(body.data(), body.size());
+        file.close();
+        if (file.fail()) {
+            std::cerr << "Error writing the file." << std::endl;
+            return false;
+        }
+        timer.addBytes(sizeof(header) + body.size());
+        std::cout << "Session saved to " << fileName << std::endl;
+        return true;
+    }
+};
+
+// Opens a session file by mapping it and turning the stored text offsets into line views that
+// point straight into the mapping; nothing is parsed or copied until the caller builds stores.
+class SessionReader {
+private:
+    MappedFile file;
+    SessionHeader header;
+    const uint64_t* snapshotStarts;
+    const uint64_t* versionLinks;
+    const uint32_t* references;
+    const char* clipboardData;
+    std::vector<LineView> lines;
+
+    static size_t padded(size_t size) {
+        return (size + 7) & ~static_cast<size_t>(7);
+    }
+
+    bool fail() {
+        std::cerr << "Invalid session file." << std::endl;
+        file.close();
+        return false;
+    }
+
+public:
+    SessionReader() : snapshotStarts(nullptr), versionLinks(nullptr), references(nullptr), clipboardData(nullptr) {}
+
+    bool open(const std::string& fileName) {
+        static OperationStats& stats = StatsRegistry::operation("SessionReader::open");
+        ScopedOperation timer(stats);
+        if (!file.open(fileName)) {
+            std::cerr << "Error opening the file." << std::endl;
+            return false;
+        }
+        timer.addBytes(file.size());
+        if (file.size() < sizeof(SessionHeader)) {
+            return fail();
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, SessionHeader::expectedMagic(), 8) != 0) {
+            return fail();
+        }
+
+        // Every count is bounded by the file size before it is multiplied, so the section
+        // arithmetic below cannot overflow.
+        const uint64_t available = file.size() - sizeof(header);
+        if (header.lineCount > available / 16 || header.snapshotCount > available / 8 ||
+            header.versionCount > available / 16 || header.referenceCount > available / 4 ||
+            header.textBytes > available || header.clipboardBytes > available) {
+            return fail();
+        }
+        const size_t lineTableBytes = padded(header.lineCount * 16);
+        const size_t snapshotBytes = padded((header.snapshotCount + 1) * 8);
+        const size_t versionBytes = header.versionCount * 16;
+        const size_t referenceBytes = padded(header.referenceCount * 4);
+        const size_t textBytes = padded(header.textBytes);
+        if (lineTableBytes + snapshotBytes + versionBytes + referenceBytes + textBytes + header.clipboardBytes !=
+            available) {
+            return fail();
+        }
+        const char* body = file.data() + sizeof(header);
+        if (hashBytes(body, available) != header.checksum) {
+            return fail();
+        }
+        if (header.versionCount == 0 || header.snapshotCount != 1 + header.versionCount ||
+            header.currentVersion >= header.versionCount || header.detached > 1 ||
+            header.encoding > TextFormat::kLatin1 || header.lineEnding > TextFormat::kCR ||
+            header.byteOrderMark > 1 || header.finalNewline > 1) {
+            return fail();
+        }
+
+        const uint64_t* lineTable = reinterpret_cast<const uint64_t*>(body);
+        snapshotStarts = reinterpret_cast<const uint64_t*>(body + lineTableBytes);
+        versionLinks = reinterpret_cast<const uint64_t*>(body + lineTableBytes + snapshotBytes);
+        references = reinterpret_cast<const uint32_t*>(body + lineTableBytes + snapshotBytes + versionBytes);
+        const char* text = body + lineTableBytes + snapshotBytes + versionBytes + referenceBytes;
+        clipboardData = text + textBytes;
+
+        if (snapshotStarts[0] != 0 || snapshotStarts[header.snapshotCount] != header.referenceCount) {
+            return fail();
+        }
+        for (uint64_t i = 0; i < header.snapshotCount; i++) {
+            if (snapshotStarts[i] > snapshotStarts[i + 1]) {
+                return fail();
+            }
+        }
+        for (uint64_t i = 0; i < header.referenceCount; i++) {
+            if (references[i] >= header.lineCount) {
+                return fail();
+            }
+        }
+        // Version 0 is the only root and parents come first, so the links form one tree; a redo
+        // child must be a child.
+        for (uint64_t i = 0; i < header.versionCount; i++) {
+            uint64_t parent = parentOf(i);
+            uint64_t redoChild = redoChildOf(i);
+            if ((i == 0) != (parent == SessionHeader::kNoVersion) || (i != 0 && parent >= i)) {
+                return fail();
+            }
+            if (redoChild != SessionHeader::kNoVersion &&
+                (redoChild >= header.versionCount || parentOf(redoChild) != i)) {
+                return fail();
+            }
+        }
+
+        // The fixups: stored offsets become pointers into the mapping.
+        lines.resize(header.lineCount);
+        for (uint64_t i = 0; i < header.lineCount; i++) {
+            uint64_t offset = lineTable[2 * i];
+            uint64_t size = lineTable[2 * i + 1];
+            if (offset > header.textBytes || size > header.textBytes - offset) {
+                return fail();
+            }
+            lines[i] = LineView(text + offset, size);
+        }
+        return true;
+    }
+
+    uint64_t versionCount() const {
+        return header.versionCount;
+    }
+
+    uint64_t currentVersion() const {
+        return header.currentVersion;
+    }
+
+    bool isDetached() const {
+        return header.detached != 0;
+    }
+
+    TextFormat format() const {
+        TextFormat stored;
+        stored.encoding = static_cast<TextFormat::Encoding>(header.encoding);
+        stored.lineEnding = static_cast<TextFormat::LineEnding>(header.lineEnding);
+        stored.byteOrderMark = header.byteOrderMark != 0;
+        stored.finalNewline = header.finalNewline != 0;
+        return stored;
+    }
+
+    uint64_t parentOf(uint64_t version) const {
+        return versionLinks[2 * version];
+    }
+
+    uint64_t redoChildOf(uint64_t version) const {
+        return versionLinks[2 * version + 1];
+    }
+
+    LineView clipboard() const {
+        return LineView(clipboardData, header.clipboardBytes);
+    }
+
+    // Lines of snapshot `index` (0 = document, then version index - 1). The views stay valid
+    // while the reader is open.
+    void snapshot(size_t index, std::vector<LineView>& views) const {
+        views.clear();
+        for (uint64_t i = snapshotStarts[index]; i < snapshotStarts[index + 1]; i++) {
+            views.push_back(lines[references[i]]);
+        }
+    }
+};
+
+#endif //HM2PP_SESSION_FILE_H
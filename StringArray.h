@@ -0,0 +1,1361 @@
+#ifndef HM2PP_STRING_ARRAY_H
+#define HM2PP_STRING_ARRAY_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ClipboardRing.h"
+#include "CompactLineStore.h"
+#include "FilesSL.h"
+#include "InternedLineStore.h"
+#include "LineDiff.h"
+#include "LineOffsetIndex.h"
+#include "LineRange.h"
+#include "LineView.h"
+#include "MemoryUsage.h"
+#include "OperationStats.h"
+#include "PagedLineStore.h"
+#include "SessionFile.h"
+#include "UndoTree.h"
+#include "VectorLineStore.h"
+
+template <typename Store>
+class BasicStringArray {
+private:
+    typedef typename Store::Snapshot Snapshot;
+
+    Store array;
+    UndoTree<Store> history;
+    // The document was replaced (loaded, set, taken) without becoming a version; the next move
+    // through the tree first adds it, so undo can come back to it.
+    bool detached;
+    ClipboardRing clipboard;
+    mutable LineOffsetIndex offsetIndex;
+    // Positions and lengths taken and reported by the editing calls count UTF-8 codepoints
+    // rather than bytes.
+    bool codepointColumns;
+
+    // Keystroke coalescing. A typing-style edit (see EditKind) that continues the previous one
+    // within `coalesceGap` replaces the top history entry instead of pushing another, so a burst
+    // of typing undoes as one step. `lastEditCursor` is where the next edit of the same kind must
+    // start to count as continuing: after an insert its end, after a delete its start.
+    enum EditKind { kOtherEdit, kAppendEdit, kInsertEdit, kDeleteEdit };
+    std::chrono::steady_clock::duration coalesceGap;
+    EditKind lastEditKind;
+    size_t lastEditLine;
+    size_t lastEditCursor;
+    std::chrono::steady_clock::time_point lastEditTime;
+    // Reads the time of an edit; the steady clock when empty.
+    std::function<std::chrono::steady_clock::time_point()> editClock;
+
+    // Open transaction: the document and clipboard as they were at beginTransaction(), and
+    // whether any edit has happened since. Edits inside it push no history.
+    std::unique_ptr<Snapshot> transactionStart;
+    ClipboardRing transactionClipboard;
+    bool transactionEdited;
+
+    // Incremental-save state. `syncedFile` held exactly the document when it was last loaded or
+    // saved, and `syncedStamp` is what it looked like then; since then only lines [dirtyBegin,
+    // dirtyEnd) were edited. Once an edit changes a line's length everything after dirtyBegin
+    // moves, so `dirtyResized` widens the rewrite to the end of the file.
+    std::string syncedFile;
+    FileStamp syncedStamp;
+    // Encoding, line ending and final newline of the file the document was loaded from; saving
+    // writes them back.
+    TextFormat textFormat;
+    size_t dirtyBegin;
+    size_t dirtyEnd;
+    bool dirtyResized;
+
+    // May rebuild the index by reading every line, which on a paged store can evict the block a
+    // LineView taken before points into; callers take views only after calling it.
+    const LineOffsetIndex& index() const {
+        if (!offsetIndex.isValid()) {
+            offsetIndex.rebuild(array);
+        }
+        return offsetIndex;
+    }
+
+    // Byte column of codepoint `column` of a line (0-based). Columns past the end of the line
+    // stay past it by as many bytes, so the usual position checks still reject them.
+    int64_t byteColumn(size_t lineIndex, int64_t column) const {
+        const LineOffsetIndex& offsets = index();
+        LineView line = array.line(lineIndex);
+        size_t position = offsets.byteColumn(lineIndex, line, static_cast<uint64_t>(column));
+        if (position == std::string::npos) {
+            return static_cast<int64_t>(line.size) + column - static_cast<int64_t>(offsets.lineCodepoints(lineIndex));
+        }
+        return static_cast<int64_t>(position);
+    }
+
+    // With codepoint columns, turns `position`, and the `length` that follows it, on a 1-based
+    // line from codepoints into bytes. Anything the callers' checks reject (no such line,
+    // negative values) is left as it is.
+    void toByteColumns(int lineIndex, int& position, int* length = nullptr) const {
+        if (!codepointColumns || lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size() || position < 0) {
+            return;
+        }
+        int64_t start = byteColumn(lineIndex - 1, position);
+        if (length && *length >= 0) {
+            *length = static_cast<int>(byteColumn(lineIndex - 1, static_cast<int64_t>(position) + *length) - start);
+        }
+        position = static_cast<int>(start);
+    }
+
+    // Column to report for a byte position of a line, in the units positions are given in.
+    int reportedColumn(size_t lineIndex, size_t position) const {
+        if (!codepointColumns) {
+            return static_cast<int>(position);
+        }
+        const LineOffsetIndex& offsets = index();
+        return static_cast<int>(offsets.codepointColumn(lineIndex, array.line(lineIndex), position));
+    }
+
+    bool isDirty() const {
+        return dirtyBegin < dirtyEnd || dirtyResized;
+    }
+
+    void markDirty(size_t lineIndex, bool resized) {
+        if (dirtyBegin < dirtyEnd) {
+            dirtyBegin = std::min(dirtyBegin, lineIndex);
+            dirtyEnd = std::max(dirtyEnd, lineIndex + 1);
+        } else {
+            dirtyBegin = lineIndex;
+            dirtyEnd = lineIndex + 1;
+        }
+        dirtyResized = dirtyResized || resized;
+    }
+
+    // `stamp` is the file as it is now, holding the document.
+    void markSynced(const std::string& fileName, const FileStamp& stamp) {
+        syncedFile = fileName;
+        syncedStamp = stamp;
+        dirtyBegin = 0;
+        dirtyEnd = 0;
+        dirtyResized = false;
+    }
+
+    // Bytes of the byte order mark and of each line break in the offsets fileOffset() counts.
+    uint64_t offsetPrefixBytes() const {
+        return textFormat.isUtf8() ? textFormat.byteOrderMarkBytes() : 0;
+    }
+
+    uint64_t offsetNewlineBytes() const {
+        return textFormat.isUtf8() ? textFormat.newlineBytes() : 1;
+    }
+
+    // Where line `line` starts in the file saveToFile writes, byte order mark and whole line
+    // endings included. UTF-8 files hold the document's bytes, so this follows from the offset
+    // index; other encodings have no such arithmetic, and there it is the offset in the
+    // document's UTF-8 text with one byte per line break.
+    uint64_t fileOffset(size_t line) const {
+        return offsetPrefixBytes() + index().lineStartByte(line) + line * (offsetNewlineBytes() - 1);
+    }
+
+    uint64_t fileBytes() const {
+        uint64_t size = fileOffset(array.size());
+        if (array.size() != 0 && !textFormat.terminatesLastLine(array.line(array.size() - 1).size)) {
+            size -= textFormat.newlineBytes();
+        }
+        return size;
+    }
+
+    void forgetSynced() {
+        syncedFile.clear();
+        markDirty(0, true);
+    }
+
+    void pushHistory() {
+        lastEditKind = kOtherEdit;
+        if (transactionStart) {
+            transactionEdited = true;
+            return;
+        }
+        static OperationStats& stats = StatsRegistry::operation("StringArray::pushHistory");
+        ScopedOperation timer(stats);
+        history.push(array);
+        detached = false;
+    }
+
+    // Adds a detached document (loaded or replaced since the current version) to the tree as a
+    // child of the current version, so an edit or move after it can be undone back to it.
+    void pushDetached() {
+        if (detached) {
+            history.push(array);
+            detached = false;
+            lastEditKind = kOtherEdit;
+        }
+    }
+
+    // Moves to another version of the undo tree, first adding a detached document as a version.
+    void switchVersion(size_t version) {
+        pushDetached();
+        history.restore(version, array);
+        lastEditKind = kOtherEdit;
+        offsetIndex.invalidate();
+        markDirty(0, true);
+    }
+
+    // pushHistory() for the edits coalescing applies to: `length` bytes inserted or deleted at
+    // `position` of `line` (0-based), or appended to it.
+    void pushTypingHistory(EditKind kind, size_t line, size_t position, size_t length) {
+        std::chrono::steady_clock::time_point now = editClock ? editClock() : std::chrono::steady_clock::now();
+        bool continues = coalesceGap != std::chrono::steady_clock::duration::zero() && kind == lastEditKind &&
+                         line == lastEditLine && now - lastEditTime <= coalesceGap &&
+                         history.parent(history.current()) != UndoTree<Store>::kNoVersion && !transactionStart;
+        if (kind == kInsertEdit) {
+            continues = continues && position == lastEditCursor;
+        } else if (kind == kDeleteEdit) {
+            // Backspace ends where the last deletion started; forward delete starts there.
+            continues = continues && (position + length == lastEditCursor || position == lastEditCursor);
+        }
+        if (continues) {
+            static OperationStats& stats = StatsRegistry::operation("StringArray::coalesceHistory");
+            ScopedOperation timer(stats);
+            history.replaceCurrent(array);
+        } else {
+            pushHistory();
+        }
+        lastEditKind = kind;
+        lastEditLine = line;
+        lastEditCursor = kind == kInsertEdit ? position + length : position;
+        lastEditTime = now;
+    }
+
+    // Checks a range from (firstLine, firstPosition) up to, not including, (lastLine,
+    // lastPosition); lines are 1-based.
+    bool isValidRange(int firstLine, int firstPosition, int lastLine, int lastPosition) const {
+        if (firstLine < 1 || lastLine < firstLine || static_cast<size_t>(lastLine) > array.size()) {
+            std::cerr << "Invalid line index." << std::endl;
+            return false;
+        }
+        if (firstPosition < 0 || static_cast<size_t>(firstPosition) > array.line(firstLine - 1).size ||
+            lastPosition < 0 || static_cast<size_t>(lastPosition) > array.line(lastLine - 1).size) {
+            std::cerr << "Invalid position." << std::endl;
+            return false;
+        }
+        if (firstLine == lastLine && lastPosition < firstPosition) {
+            std::cerr << "Invalid range." << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Text of a valid range with its line breaks. Part of a single line is shared with the store
+    // rather than copied.
+    TextSlice rangeText(int firstLine, int firstPosition, int lastLine, int lastPosition) const {
+        if (firstLine == lastLine) {
+            return array.share(firstLine - 1, firstPosition, lastPosition - firstPosition);
+        }
+        LineView first = array.line(firstLine - 1);
+        std::string text(first.data + firstPosition, first.size - firstPosition);
+        for (int i = firstLine; i < lastLine - 1; i++) {
+            LineView line = array.line(i);
+            text.push_back('\n');
+            text.append(line.data, line.size);
+        }
+        text.push_back('\n');
+        text.append(array.line(lastLine - 1).data, lastPosition);
+        return TextSlice::copy(text.data(), text.size());
+    }
+
+    // Inserts whole lines before line index `at` (0-based), keeping the offset index valid when
+    // they go at the end.
+    void spliceLines(size_t at, const LineView* lines, size_t count) {
+        bool atEnd = at == array.size();
+        array.splice(at, 0, lines, count);
+        if (atEnd) {
+            for (size_t i = 0; i < count; i++) {
+                offsetIndex.append(lines[i]);
+            }
+        } else {
+            offsetIndex.invalidate();
+        }
+        markDirty(at, true);
+    }
+
+    template <typename Text>
+    void appendString(Text&& buffer) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::addString");
+        ScopedOperation timer(stats);
+        size_t size = buffer.size();
+        timer.addBytes(size);
+        pushDetached();
+        if (array.size() != 0) {
+            array.modify(array.size() - 1, [&](std::string& line) {
+                if (line.empty()) {
+                    line = std::forward<Text>(buffer);
+                } else {
+                    line += buffer;
+                }
+            });
+            offsetIndex.update(array.size() - 1, array.line(array.size() - 1));
+        } else {
+            array.push_back(std::forward<Text>(buffer));
+            offsetIndex.append(array.line(0));
+        }
+        markDirty(array.size() - 1, size != 0 || array.size() == 1);
+        pushTypingHistory(kAppendEdit, array.size() - 1, 0, size);
+    }
+
+    // Replaces a valid range with `text`, which may span lines, in one splice of the store.
+    void replaceRange(int firstLine, int firstPosition, int lastLine, int lastPosition, LineView text) {
+        const char* lineBreak = static_cast<const char*>(std::memchr(text.data, '\n', text.size));
+        if (firstLine == lastLine && lineBreak == nullptr) {
+            array.modify(firstLine - 1, [&](std::string& line) {
+                line.replace(firstPosition, lastPosition - firstPosition, text.data, text.size);
+            });
+            offsetIndex.update(firstLine - 1, array.line(firstLine - 1));
+            markDirty(firstLine - 1, static_cast<size_t>(lastPosition - firstPosition) != text.size);
+            return;
+        }
+
+        LineView last = array.line(lastLine - 1);
+        std::string tail(last.data + lastPosition, last.size - lastPosition);
+        std::string head = array.line(firstLine - 1).substr(0, firstPosition);
+        std::vector<LineView> lines;
+        const char* start = text.data;
+        const char* end = text.data + text.size;
+        while (lineBreak != nullptr) {
+            lines.push_back(LineView(start, lineBreak - start));
+            start = lineBreak + 1;
+            lineBreak = static_cast<const char*>(std::memchr(start, '\n', end - start));
+        }
+        lines.push_back(LineView(start, end - start));
+        head.append(lines.front().data, lines.front().size);
+        if (lines.size() == 1) {
+            head += tail;
+            lines.front() = head;
+        } else {
+            tail.insert(0, lines.back().data, lines.back().size);
+            lines.front() = head;
+            lines.back() = tail;
+        }
+        array.splice(firstLine - 1, lastLine - firstLine + 1, lines.data(), lines.size());
+        offsetIndex.invalidate();
+        markDirty(firstLine - 1, true);
+    }
+
+public:
+    BasicStringArray()
+        : history(array.snapshot()), detached(false), codepointColumns(false), coalesceGap(std::chrono::steady_clock::duration::zero()),
+          lastEditKind(kOtherEdit), lastEditLine(0), lastEditCursor(0), transactionEdited(false),
+          dirtyBegin(0), dirtyEnd(0), dirtyResized(false) {}
+
+    // Number of most recently used versions kept expanded; older ones are compressed. Applies
+    // from the next edit or undo on.
+    void setHotHistory(size_t entries) {
+        history.setHotVersions(entries);
+    }
+
+    // Most versions the undo tree keeps (0, the default, keeps all), a count of versions
+    // whatever their size; the least recently used branches go first. Dropped versions' ids
+    // are never reused.
+    void setHistoryLimit(size_t versions) {
+        history.setVersionLimit(versions);
+    }
+
+    // Switches every line position and length the editing calls take (insert, delete, cut, copy,
+    // paste, the range operations and the offset conversions) between bytes, the default, and
+    // UTF-8 codepoints. Codepoint columns never split a character.
+    void setCodepointColumns(bool enabled) {
+        codepointColumns = enabled;
+    }
+
+    bool usesCodepointColumns() const {
+        return codepointColumns;
+    }
+
+    // Merges consecutive appends, adjacent inserts and adjacent deletes on one line into one
+    // history entry while each follows the previous within `idleGap`. Zero (the default)
+    // gives every edit its own entry.
+    void setCoalescing(std::chrono::milliseconds idleGap) {
+        coalesceGap = idleGap;
+        lastEditKind = kOtherEdit;
+    }
+
+    // Replaces the clock coalescing measures the gap between edits with, so a replay can run
+    // at full speed and still coalesce as the recorded session did. An empty clock restores the
+    // steady clock.
+    void setEditClock(std::function<std::chrono::steady_clock::time_point()> clock) {
+        editClock = std::move(clock);
+    }
+
+    // Copy of the document; lines() reads it without copying.
+    std::vector<std::string> getStrings() const {
+        return array.toVector();
+    }
+
+    const Store& getStore() const {
+        return array;
+    }
+
+    // Non-owning view of the document, valid until the next edit.
+    LineRange<Store> lines() const {
+        return LineRange<Store>(array);
+    }
+
+    // Lines firstLine..lastLine (1-based, inclusive); an empty range if they are out of bounds.
+    LineRange<Store> lines(int firstLine, int lastLine) const {
+        if (firstLine < 1 || lastLine < firstLine || static_cast<size_t>(lastLine) > array.size()) {
+            std::cerr << "Invalid line range." << std::endl;
+            return LineRange<Store>(array, 0, 0);
+        }
+        return LineRange<Store>(array, firstLine - 1, lastLine);
+    }
+
+    // Moves the document out and leaves it empty. Like setStrings, this does not touch history.
+    std::vector<std::string> takeStrings() {
+        std::vector<std::string> result = array.release();
+        lastEditKind = kOtherEdit;
+        detached = true;
+        offsetIndex.invalidate();
+        forgetSynced();
+        return result;
+    }
+
+    // Replacing the whole document also abandons an open transaction.
+    void setStrings(const std::vector<std::string>& data) {
+        array.assign(data);
+        transactionStart.reset();
+        lastEditKind = kOtherEdit;
+        detached = true;
+        offsetIndex.invalidate();
+        forgetSynced();
+    }
+
+    // Takes over the strings' buffers where the store keeps std::strings (VectorLineStore).
+    void setStrings(std::vector<std::string>&& data) {
+        array.assign(std::move(data));
+        transactionStart.reset();
+        lastEditKind = kOtherEdit;
+        detached = true;
+        offsetIndex.invalidate();
+        forgetSynced();
+    }
+
+    void setStore(Store&& data) {
+        array = std::move(data);
+        transactionStart.reset();
+        lastEditKind = kOtherEdit;
+        detached = true;
+        offsetIndex.invalidate();
+        forgetSynced();
+    }
+
+    // Groups the edits up to commitTransaction() into one history entry, so a single undo
+    // reverts all of them; rollbackTransaction() reverts them right away. Transactions do not
+    // nest, and undo/redo are refused while one is open.
+    bool beginTransaction() {
+        if (transactionStart) {
+            std::cerr << "A transaction is already open." << std::endl;
+            return false;
+        }
+        pushDetached();
+        transactionStart.reset(new Snapshot(array.snapshot()));
+        transactionClipboard = clipboard;
+        transactionEdited = false;
+        return true;
+    }
+
+    bool commitTransaction() {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::commitTransaction");
+        ScopedOperation timer(stats);
+        if (!transactionStart) {
+            std::cerr << "No transaction is open." << std::endl;
+            return false;
+        }
+        transactionStart.reset();
+        transactionClipboard.clear();
+        if (transactionEdited) {
+            pushHistory();
+        }
+        return true;
+    }
+
+    bool rollbackTransaction() {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::rollbackTransaction");
+        ScopedOperation timer(stats);
+        if (!transactionStart) {
+            std::cerr << "No transaction is open." << std::endl;
+            return false;
+        }
+        if (transactionEdited) {
+            array.restore(*transactionStart);
+            offsetIndex.invalidate();
+            markDirty(0, true);
+        }
+        clipboard = transactionClipboard;
+        transactionClipboard.clear();
+        transactionStart.reset();
+        return true;
+    }
+
+    bool inTransaction() const {
+        return static_cast<bool>(transactionStart);
+    }
+
+    // Replaces the document with the lines of the file, converted to UTF-8, and remembers the
+    // file's format for saving. A file that cannot be opened leaves an empty document, as before.
+    bool loadFromFile(const std::string& fileName) {
+        Store loaded;
+        TextFormat format;
+        bool opened = FilesSL::loadFromFile(fileName, loaded, format);
+        setStore(std::move(loaded));
+        if (opened) {
+            textFormat = format;
+            FileStamp stamp;
+            if (textFormat.isUtf8() && FilesSL::fileStamp(fileName, stamp) && stamp.size == fileBytes()) {
+                markSynced(fileName, stamp);
+            }
+        }
+        return opened;
+    }
+
+    // Format saveToFile writes; setting it converts the file on the next save.
+    const TextFormat& getTextFormat() const {
+        return textFormat;
+    }
+
+    void setTextFormat(const TextFormat& format) {
+        textFormat = format;
+        forgetSynced();
+    }
+
+    // Saves the document. When `fileName` is the file it was last loaded from or saved to, and
+    // that file still has the size, modification time and inode it was left with, only the
+    // changed part is written: the edited lines in place when no line changed length, otherwise
+    // everything from the first edited line onward. Any other target, a file changed outside
+    // the editor, or a file that is not UTF-8, gets a full rewrite.
+    bool saveToFile(const std::string& fileName) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::saveToFile");
+        ScopedOperation timer(stats);
+        FileStamp stamp;
+        bool ok;
+        if (fileName == syncedFile && FilesSL::fileStamp(fileName, stamp) && stamp == syncedStamp) {
+            if (!isDirty()) {
+                std::cout << "Array saved to " << fileName << std::endl;
+                return true;
+            }
+            size_t first = std::min(dirtyBegin, array.size());
+            size_t last = dirtyResized ? array.size() : std::min(dirtyEnd, array.size());
+            if (!textFormat.finalNewline && first != 0) {
+                // The line before may have been the last one, saved without its newline.
+                first--;
+            }
+            ok = FilesSL::patchFile(fileName, array, first, last, fileOffset(first), fileBytes(), textFormat);
+        } else {
+            ok = FilesSL::saveToFile(fileName, array, textFormat);
+        }
+        if (ok && textFormat.isUtf8() && FilesSL::fileStamp(fileName, stamp) && stamp.size == fileBytes()) {
+            markSynced(fileName, stamp);
+        } else {
+            forgetSynced();
+        }
+        return ok;
+    }
+
+    // Writes the document, the whole undo tree and the clipboard registers to one session file.
+    // Versions are renumbered parents first (depth first from the root) and dropped ones left out.
+    bool saveSession(const std::string& fileName) const {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::saveSession");
+        ScopedOperation timer(stats);
+        const size_t none = UndoTree<Store>::kNoVersion;
+        const uint64_t noLink = SessionHeader::kNoVersion;
+        std::vector<size_t> order;
+        std::unordered_map<size_t, size_t> renumbered;
+        std::vector<size_t> pending(1, history.root());
+        while (!pending.empty()) {
+            size_t version = pending.back();
+            pending.pop_back();
+            renumbered[version] = order.size();
+            order.push_back(version);
+            std::vector<size_t> children = history.children(version);
+            pending.insert(pending.end(), children.rbegin(), children.rend());
+        }
+
+        SessionWriter writer;
+        writer.addSnapshot(array);
+        LineViewList unpacked;
+        std::vector<uint64_t> links;
+        for (size_t version : order) {
+            history.visitLines(version, unpacked, [&](const Snapshot& lines) {
+                writer.addSnapshot(lines);
+            }, [&](const LineViewList& lines) { writer.addSnapshot(lines); });
+            size_t parent = history.parent(version);
+            size_t redoChild = history.redoChild(version);
+            links.push_back(parent == none ? noLink : renumbered[parent]);
+            links.push_back(redoChild == none ? noLink : renumbered[redoChild]);
+        }
+        std::string registers;
+        clipboard.encode(registers);
+        return writer.write(fileName, links, renumbered[history.current()], detached, textFormat, registers);
+    }
+
+    // Replaces the whole editing state, the format the document saves in included, with a session
+    // file written by saveSession. On failure nothing changes.
+    bool loadSession(const std::string& fileName) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::loadSession");
+        ScopedOperation timer(stats);
+        SessionReader reader;
+        ClipboardRing registers(clipboard.capacity());
+        if (!reader.open(fileName)) {
+            return false;
+        }
+        LineView encodedRegisters = reader.clipboard();
+        if (!registers.decode(encodedRegisters.data, encodedRegisters.size)) {
+            std::cerr << "Invalid session file." << std::endl;
+            return false;
+        }
+
+        // One scratch store builds every snapshot, so stores that share lines between
+        // snapshots (InternedLineStore) share them again after the restore. Only the current
+        // version and its ancestors and descendants up to the hot window are expanded; the other
+        // versions are packed straight from the mapped text.
+        const size_t versionCount = reader.versionCount();
+        const size_t current = reader.currentVersion();
+        const size_t hotVersions = history.getHotVersions();
+        std::vector<size_t> distance(versionCount, versionCount);
+        for (size_t version = current, steps = 0; steps < hotVersions; version = reader.parentOf(version), steps++) {
+            distance[version] = steps;
+            if (version == 0) {
+                break;
+            }
+        }
+
+        Store scratch;
+        LineViewList lines;
+        std::vector<LineView>& views = lines.views;
+        reader.snapshot(1, views);
+        scratch.assign(views.data(), views.size());
+        UndoTree<Store> versions(scratch.snapshot());
+        versions.setHotVersions(hotVersions);
+        versions.setVersionLimit(history.getVersionLimit());
+        for (size_t i = 1; i < versionCount; i++) {
+            // Parents come first, so this ends as the distance through the nearest ancestor of
+            // the current version.
+            size_t parent = reader.parentOf(i);
+            distance[i] = std::min(distance[i], distance[parent] + 1);
+            reader.snapshot(1 + i, views);
+            if (distance[i] < hotVersions) {
+                scratch.assign(views.data(), views.size());
+                versions.addVersion(parent, scratch.snapshot());
+            } else {
+                versions.addPackedVersion(parent, lines);
+            }
+        }
+        for (size_t i = 0; i < versionCount; i++) {
+            if (reader.redoChildOf(i) != SessionHeader::kNoVersion) {
+                versions.setRedoChild(i, reader.redoChildOf(i));
+            }
+        }
+        versions.setCurrent(current);
+        reader.snapshot(0, views);
+        scratch.assign(views.data(), views.size());
+
+        array = std::move(scratch);
+        history = std::move(versions);
+        detached = reader.isDetached();
+        textFormat = reader.format();
+        transactionStart.reset();
+        lastEditKind = kOtherEdit;
+        clipboard = registers;
+        offsetIndex.invalidate();
+        forgetSynced();
+        std::cout << "Session loaded from " << fileName << std::endl;
+        return true;
+    }
+
+    // Appends what an edit journal checkpoint restores: a varint length and the encoded clipboard
+    // registers, then, with `withDocument`, the packed document.
+    void writeCheckpoint(std::string& out, bool withDocument) const {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::writeCheckpoint");
+        ScopedOperation timer(stats);
+        std::string registers;
+        clipboard.encode(registers);
+        appendVarint(out, registers.size());
+        out.append(registers);
+        if (withDocument) {
+            PackedLines packed;
+            packed.pack(array);
+            out.append(packed.bytes());
+        }
+    }
+
+    // Restores a checkpoint. A document in it replaces this one the way setStrings does, without
+    // touching history. Returns false, changing nothing, if the data is not a checkpoint.
+    bool readCheckpoint(const char* data, size_t size) {
+        const char* cursor = data;
+        const char* end = data + size;
+        uint64_t registersSize;
+        ClipboardRing registers(clipboard.capacity());
+        if (!readVarint(cursor, end, registersSize) || registersSize > static_cast<uint64_t>(end - cursor) ||
+            !registers.decode(cursor, static_cast<size_t>(registersSize))) {
+            return false;
+        }
+        cursor += registersSize;
+        if (cursor != end) {
+            PackedLines packed;
+            packed.assign(cursor, end - cursor);
+            LineViewList lines;
+            if (!packed.unpack(lines)) {
+                return false;
+            }
+            Store restored;
+            restored.assign(lines.views.data(), lines.views.size());
+            setStore(std::move(restored));
+        }
+        clipboard = registers;
+        return true;
+    }
+
+    size_t getStringCount() const {
+        return array.size();
+    }
+
+    void addString(const std::string& buffer) {
+        appendString(buffer);
+    }
+
+    // Moves `buffer` in when there is no line yet or the last one is empty, which is how
+    // addEmptyLine followed by addString builds a document.
+    void addString(std::string&& buffer) {
+        appendString(std::move(buffer));
+    }
+
+    void addEmptyLine() {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::addEmptyLine");
+        ScopedOperation timer(stats);
+        pushDetached();
+        array.push_back("", 0);
+        offsetIndex.append(LineView());
+        markDirty(array.size() - 1, true);
+        pushHistory();
+    }
+
+    // Inserts `lines` before line `lineIndex` (1-based; one past the last line appends) in one
+    // splice of the store and one history entry.
+    void insertLines(int lineIndex, const std::vector<std::string>& lines) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::insertLines");
+        ScopedOperation timer(stats);
+        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size() + 1) {
+            std::cerr << "Invalid line index." << std::endl;
+            return;
+        }
+        if (lines.empty()) {
+            return;
+        }
+        std::vector<LineView> views;
+        views.reserve(lines.size());
+        for (const std::string& line : lines) {
+            views.push_back(line);
+            timer.addBytes(line.size() + 1);
+        }
+        pushDetached();
+        spliceLines(lineIndex - 1, views.data(), views.size());
+        pushHistory();
+    }
+
+    void appendLines(const std::vector<std::string>& lines) {
+        insertLines(static_cast<int>(array.size()) + 1, lines);
+    }
+
+    // Reads lines from `in` until it ends and inserts them like insertLines, a batch at a time so
+    // only one batch is held outside the store. Returns the number of lines inserted.
+    size_t insertLines(int lineIndex, std::istream& in) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::insertLines");
+        ScopedOperation timer(stats);
+        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size() + 1) {
+            std::cerr << "Invalid line index." << std::endl;
+            return 0;
+        }
+        const size_t batchLines = 64 * 1024;
+        std::vector<std::string> batch(batchLines);
+        std::vector<LineView> views;
+        views.reserve(batchLines);
+        size_t inserted = 0;
+        while (true) {
+            size_t count = 0;
+            while (count < batchLines && std::getline(in, batch[count])) {
+                timer.addBytes(batch[count].size() + 1);
+                count++;
+            }
+            if (count == 0) {
+                break;
+            }
+            pushDetached();
+            views.assign(batch.begin(), batch.begin() + count);
+            spliceLines(lineIndex - 1 + inserted, views.data(), count);
+            inserted += count;
+            if (count < batchLines) {
+                break;
+            }
+        }
+        if (inserted != 0) {
+            pushHistory();
+        }
+        return inserted;
+    }
+
+    size_t appendLines(std::istream& in) {
+        return insertLines(static_cast<int>(array.size()) + 1, in);
+    }
+
+    void printStrings() {
+        if (array.size() != 0) {
+            printStrings(1, static_cast<int>(array.size()));
+        }
+    }
+
+    // Prints lines firstLine..lastLine (1-based, inclusive). Output is assembled in a large
+    // buffer and flushed once instead of once per line.
+    void printStrings(int firstLine, int lastLine) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::printStrings");
+        ScopedOperation timer(stats);
+        if (firstLine < 1 || lastLine < firstLine || static_cast<size_t>(lastLine) > array.size()) {
+            std::cerr << "Invalid line range." << std::endl;
+            return;
+        }
+
+        const size_t flushThreshold = 1 << 20;
+        std::string buffer;
+        buffer.reserve(flushThreshold + 4096);
+        char digits[24];
+        for (size_t i = firstLine - 1; i < static_cast<size_t>(lastLine); i++) {
+            size_t number = i + 1;
+            char* end = digits + sizeof(digits);
+            char* begin = end;
+            do {
+                *--begin = static_cast<char>('0' + number % 10);
+                number /= 10;
+            } while (number != 0);
+            buffer.append(begin, end);
+            buffer.append(": ", 2);
+            LineView line = array.line(i);
+            buffer.append(line.data, line.size);
+            buffer.push_back('\n');
+
+            if (buffer.size() >= flushThreshold) {
+                timer.addBytes(buffer.size());
+                std::cout.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        }
+        timer.addBytes(buffer.size());
+        std::cout.write(buffer.data(), buffer.size());
+        std::cout.flush();
+    }
+
+    // Prints a window of at most `height` lines starting at firstLine.
+    void printViewport(int firstLine, int height) {
+        if (firstLine < 1 || static_cast<size_t>(firstLine) > array.size()) {
+            std::cerr << "Invalid line index." << std::endl;
+            return;
+        }
+        if (height < 1) {
+            std::cerr << "Invalid number of lines." << std::endl;
+            return;
+        }
+        size_t lastLine = std::min(array.size(), static_cast<size_t>(firstLine) + height - 1);
+        printStrings(firstLine, static_cast<int>(lastLine));
+    }
+
+    void deleteSubstring(int lineIndex, int position, int length) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::deleteSubstring");
+        ScopedOperation timer(stats);
+        toByteColumns(lineIndex, position, &length);
+        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size()) {
+            std::cerr << "Invalid line index." << std::endl;
+            return;
+        }
+
+        LineView line = array.line(lineIndex - 1);
+
+        if (position < 0 || static_cast<size_t>(position) >= line.size) {
+            std::cerr << "Invalid position." << std::endl;
+            return;
+        }
+
+        if (length < 0 || static_cast<size_t>(position + length) > line.size) {
+            std::cerr << "Invalid length." << std::endl;
+            return;
+        }
+
+        pushDetached();
+        clipboard.push(array.share(lineIndex - 1, position, length));
+        timer.addBytes(length);
+        array.modify(lineIndex - 1, [&](std::string& text) { text.erase(position, length); });
+        offsetIndex.update(lineIndex - 1, array.line(lineIndex - 1));
+        markDirty(lineIndex - 1, length != 0);
+        pushTypingHistory(kDeleteEdit, lineIndex - 1, position, length);
+    }
+
+    void undo() {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::undo");
+        ScopedOperation timer(stats);
+        if (transactionStart) {
+            std::cerr << "Commit or roll back the transaction first." << std::endl;
+            return;
+        }
+        lastEditKind = kOtherEdit;
+        pushDetached();
+        size_t parent = history.parent(history.current());
+        if (parent != UndoTree<Store>::kNoVersion) {
+            switchVersion(parent);
+        }
+    }
+
+    void redo() {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::redo");
+        ScopedOperation timer(stats);
+        if (transactionStart) {
+            std::cerr << "Commit or roll back the transaction first." << std::endl;
+            return;
+        }
+        lastEditKind = kOtherEdit;
+        size_t child = history.redoChild(history.current());
+        if (child != UndoTree<Store>::kNoVersion) {
+            switchVersion(child);
+        }
+    }
+
+    // Makes any version of the undo tree the document, however far it is from the current one.
+    // Undo and redo then continue from there.
+    bool gotoVersion(size_t version) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::gotoVersion");
+        ScopedOperation timer(stats);
+        if (transactionStart) {
+            std::cerr << "Commit or roll back the transaction first." << std::endl;
+            return false;
+        }
+        if (!history.isLive(version)) {
+            std::cerr << "Invalid version." << std::endl;
+            return false;
+        }
+        switchVersion(version);
+        return true;
+    }
+
+    size_t currentVersion() const {
+        return history.current();
+    }
+
+    // The id the next version added to the undo tree gets; ids only grow.
+    size_t nextVersionId() const {
+        return history.nextVersionId();
+    }
+
+    size_t parentVersion(size_t version) const {
+        return history.parent(version);
+    }
+
+    // Whether the document was replaced outside history and is not a version yet.
+    bool isDetached() const {
+        return detached;
+    }
+
+    // The version holding the document as it is, adding a detached document to the tree first.
+    size_t versionOfDocument() {
+        pushDetached();
+        return history.current();
+    }
+
+    void printVersions(std::ostream& out) const {
+        history.print(out);
+    }
+
+    // Unified diff from `other` (anything with size() and line(i), such as another document's
+    // getStore()) to this document.
+    template <typename Lines>
+    void printDiff(std::ostream& out, const Lines& other, const std::string& otherName) const {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::diff");
+        ScopedOperation timer(stats);
+        writeDiff(out, other, otherName, array, "document");
+    }
+
+    // What changed since the file was written: a diff from its contents to this document.
+    bool printFileDiff(std::ostream& out, const std::string& fileName) const {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::diff");
+        ScopedOperation timer(stats);
+        Store saved;
+        if (!FilesSL::loadFromFile(fileName, saved)) {
+            return false;
+        }
+        writeDiff(out, saved, fileName, array, "document");
+        return true;
+    }
+
+    // Diff from a version of the undo tree to this document.
+    bool printVersionDiff(std::ostream& out, size_t version) const {
+        return printVersionDiff(out, version, UndoTree<Store>::kNoVersion);
+    }
+
+    // Diff between two versions of the undo tree, or from `from` to this document when `to` is
+    // kNoVersion.
+    bool printVersionDiff(std::ostream& out, size_t from, size_t to) const {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::diff");
+        ScopedOperation timer(stats);
+        const size_t none = UndoTree<Store>::kNoVersion;
+        if (!history.isLive(from) || (to != none && !history.isLive(to))) {
+            std::cerr << "Invalid version." << std::endl;
+            return false;
+        }
+        LineViewList fromLines;
+        LineViewList toLines;
+        VersionDiff diff = {*this, out, to, toLines, "version " + std::to_string(from),
+                            to == none ? std::string("document") : "version " + std::to_string(to)};
+        history.visitLines(from, fromLines, diff, diff);
+        return true;
+    }
+
+    void insertSubstring(int lineIndex, int position, const std::string& substring, bool replace = false) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::insertSubstring");
+        ScopedOperation timer(stats);
+        timer.addBytes(substring.size());
+        // A replacing insert overwrites as many characters as it inserts.
+        int replaced = codepointColumns ? static_cast<int>(countCodepoints(substring.data(), substring.size()))
+                                        : static_cast<int>(substring.length());
+        toByteColumns(lineIndex, position, &replaced);
+        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size()) {
+            std::cerr << "Invalid line index." << std::endl;
+            return;
+        }
+
+        if (position < 0 || static_cast<size_t>(position) > array.line(lineIndex - 1).size) {
+            std::cerr << "Invalid position." << std::endl;
+            return;
+        }
+
+        pushDetached();
+        size_t oldSize = array.line(lineIndex - 1).size;
+        array.modify(lineIndex - 1, [&](std::string& line) {
+            if (replace) {
+                line.erase(position, replaced);
+                line.insert(position, substring);
+            } else {
+                line.insert(position, substring);
+            }
+        });
+        offsetIndex.update(lineIndex - 1, array.line(lineIndex - 1));
+        markDirty(lineIndex - 1, array.line(lineIndex - 1).size != oldSize);
+
+        if (replace) {
+            pushHistory();
+        } else {
+            pushTypingHistory(kInsertEdit, lineIndex - 1, position, substring.size());
+        }
+    }
+
+    void cut(int lineIndex, int position, int length) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::cut");
+        ScopedOperation timer(stats);
+        toByteColumns(lineIndex, position, &length);
+        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size()) {
+            std::cerr << "Invalid line index." << std::endl;
+            return;
+        }
+
+        LineView line = array.line(lineIndex - 1);
+
+        if (position < 0 || static_cast<size_t>(position) >= line.size) {
+            std::cerr << "Invalid position." << std::endl;
+            return;
+        }
+
+        if (length < 0 || static_cast<size_t>(position + length) > line.size) {
+            std::cerr << "Invalid length." << std::endl;
+            return;
+        }
+
+        pushDetached();
+        clipboard.push(array.share(lineIndex - 1, position, length));
+        timer.addBytes(length);
+        array.modify(lineIndex - 1, [&](std::string& text) { text.erase(position, length); });
+        offsetIndex.update(lineIndex - 1, array.line(lineIndex - 1));
+        markDirty(lineIndex - 1, length != 0);
+        pushHistory();
+    }
+
+    void copy(int lineIndex, int position, int length) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::copy");
+        ScopedOperation timer(stats);
+        toByteColumns(lineIndex, position, &length);
+        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size()) {
+            std::cerr << "Invalid line index." << std::endl;
+            return;
+        }
+
+        LineView line = array.line(lineIndex - 1);
+
+        if (position < 0 || static_cast<size_t>(position) >= line.size) {
+            std::cerr << "Invalid position." << std::endl;
+            return;
+        }
+
+        if (length < 0 || static_cast<size_t>(position + length) > line.size) {
+            std::cerr << "Invalid length." << std::endl;
+            return;
+        }
+
+        clipboard.push(array.share(lineIndex - 1, position, length));
+        timer.addBytes(length);
+    }
+
+    // Pastes clipboard register `clipboardRegister`, 1 being the most recent cut or copy.
+    void paste(int lineIndex, int position, int clipboardRegister = 1) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::paste");
+        ScopedOperation timer(stats);
+        toByteColumns(lineIndex, position);
+        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size()) {
+            std::cerr << "Invalid line index." << std::endl;
+            return;
+        }
+
+        if (position < 0 || static_cast<size_t>(position) > array.line(lineIndex - 1).size) {
+            std::cerr << "Invalid position." << std::endl;
+            return;
+        }
+
+        if (clipboardRegister < 1 || static_cast<size_t>(clipboardRegister) > std::max<size_t>(clipboard.size(), 1)) {
+            std::cerr << "Invalid register." << std::endl;
+            return;
+        }
+
+        // Holding the slice keeps its text alive even if it references the line being edited.
+        pushDetached();
+        TextSlice text = clipboard.get(clipboardRegister - 1);
+        timer.addBytes(text.size());
+        replaceRange(lineIndex, position, lineIndex, position, text.view());
+        pushHistory();
+    }
+
+    // Range operations span from (firstLine, firstPosition) up to, not including, (lastLine,
+    // lastPosition), and the text between lines is a '\n'. Each is one splice of the store and
+    // one history entry however many lines it covers; paste() puts multi-line text back.
+    void cutRange(int firstLine, int firstPosition, int lastLine, int lastPosition) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::cutRange");
+        ScopedOperation timer(stats);
+        toByteColumns(firstLine, firstPosition);
+        toByteColumns(lastLine, lastPosition);
+        if (!isValidRange(firstLine, firstPosition, lastLine, lastPosition)) {
+            return;
+        }
+        TextSlice text = rangeText(firstLine, firstPosition, lastLine, lastPosition);
+        timer.addBytes(text.size());
+        pushDetached();
+        clipboard.push(text);
+        replaceRange(firstLine, firstPosition, lastLine, lastPosition, LineView());
+        pushHistory();
+    }
+
+    void copyRange(int firstLine, int firstPosition, int lastLine, int lastPosition) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::copyRange");
+        ScopedOperation timer(stats);
+        toByteColumns(firstLine, firstPosition);
+        toByteColumns(lastLine, lastPosition);
+        if (!isValidRange(firstLine, firstPosition, lastLine, lastPosition)) {
+            return;
+        }
+        TextSlice text = rangeText(firstLine, firstPosition, lastLine, lastPosition);
+        timer.addBytes(text.size());
+        clipboard.push(text);
+    }
+
+    // Like cutRange, but leaves the clipboard alone.
+    void deleteRange(int firstLine, int firstPosition, int lastLine, int lastPosition) {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::deleteRange");
+        ScopedOperation timer(stats);
+        toByteColumns(firstLine, firstPosition);
+        toByteColumns(lastLine, lastPosition);
+        if (!isValidRange(firstLine, firstPosition, lastLine, lastPosition)) {
+            return;
+        }
+        pushDetached();
+        replaceRange(firstLine, firstPosition, lastLine, lastPosition, LineView());
+        pushHistory();
+    }
+
+    // Lists the clipboard registers, most recent first, each cut to `width` bytes.
+    void printClipboard(std::ostream& out, size_t width = 60) const {
+        if (clipboard.size() == 0) {
+            out << "Clipboard is empty." << std::endl;
+            return;
+        }
+        for (size_t i = 0; i < clipboard.size(); i++) {
+            LineView text = clipboard.get(i).view();
+            out << i + 1 << ": " << LineView(text.data, std::min(text.size, width));
+            if (text.size > width) {
+                out << "... (" << text.size << " bytes)";
+            }
+            out << std::endl;
+        }
+    }
+
+    // Converts an absolute byte offset in the file saveToFile writes (see fileOffset) into a
+    // 1-based line and a position within it. An offset on a line break, or the end of a file
+    // without a final newline, maps to the end of that line; one inside the byte order mark is
+    // invalid.
+    bool offsetToPosition(uint64_t offset, int& lineIndex, int& position) const {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::offsetToPosition");
+        ScopedOperation timer(stats);
+        if (offset < offsetPrefixBytes() || offset >= fileOffset(array.size()) || offset > fileBytes()) {
+            std::cerr << "Invalid offset." << std::endl;
+            return false;
+        }
+        uint64_t column;
+        size_t line = index().lineAtByte(offset - offsetPrefixBytes(), column, offsetNewlineBytes() - 1);
+        column = std::min<uint64_t>(column, array.line(line).size);
+        lineIndex = static_cast<int>(line) + 1;
+        position = reportedColumn(line, static_cast<size_t>(column));
+        return true;
+    }
+
+    bool positionToOffset(int lineIndex, int position, uint64_t& offset) const {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::positionToOffset");
+        ScopedOperation timer(stats);
+        toByteColumns(lineIndex, position);
+        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size()) {
+            std::cerr << "Invalid line index." << std::endl;
+            return false;
+        }
+        if (position < 0 || static_cast<size_t>(position) > array.line(lineIndex - 1).size) {
+            std::cerr << "Invalid position." << std::endl;
+            return false;
+        }
+        offset = fileOffset(lineIndex - 1) + position;
+        return true;
+    }
+
+    // Like offsetToPosition, but the offset counts the UTF-8 codepoints of the document, one
+    // per line break, whatever the file's format.
+    bool codepointOffsetToPosition(uint64_t offset, int& lineIndex, int& position) const {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::codepointOffsetToPosition");
+        ScopedOperation timer(stats);
+        if (offset >= index().totalCodepoints()) {
+            std::cerr << "Invalid offset." << std::endl;
+            return false;
+        }
+        uint64_t column;
+        size_t line = index().lineAtCodepoint(offset, column);
+        lineIndex = static_cast<int>(line) + 1;
+        position = codepointColumns ? static_cast<int>(column) : static_cast<int>(byteColumn(line, column));
+        return true;
+    }
+
+    bool positionToCodepointOffset(int lineIndex, int position, uint64_t& offset) const {
+        static OperationStats& stats = StatsRegistry::operation("StringArray::positionToCodepointOffset");
+        ScopedOperation timer(stats);
+        uint64_t byteOffset;
+        if (!positionToOffset(lineIndex, position, byteOffset)) {
+            return false;
+        }
+        size_t line = static_cast<size_t>(lineIndex) - 1;
+        toByteColumns(lineIndex, position);
+        const LineOffsetIndex& offsets = index();
+        offset = offsets.lineStartCodepoint(line) + offsets.codepointColumn(line, array.line(line), position);
+        return true;
+    }
+
+    // Prints how much heap the document, the undo tree, the clipboard and the offset index
+    // hold, including spare capacity and estimated allocator overhead. Clipboard registers that
+    // reference document lines count only with the store that owns those lines.
+    void printMemoryUsage(std::ostream& out) const {
+        MemoryUsage document = array.memoryUsage();
+
+        MemoryUsage versions = history.memoryUsage();
+        size_t packedVersions = 0;
+        MemoryUsage packedHistory = history.packedMemoryUsage(packedVersions);
+
+        MemoryUsage clipboardUsage = clipboard.memoryUsage();
+        if (transactionStart) {
+            versions += transactionStart->memoryUsage();
+        }
+
+        MemoryUsage indexUsage = offsetIndex.memoryUsage();
+
+        MemoryUsage total = document;
+        total += versions;
+        total += packedHistory;
+        total += clipboardUsage;
+        total += indexUsage;
+
+        out << std::left << std::setw(16) << "component" << std::right << std::setw(10) << "items"
+            << std::setw(14) << "live" << std::setw(14) << "allocated" << std::setw(12) << "overhead"
+            << std::setw(14) << "total" << std::setw(10) << "blocks" << std::endl;
+        printMemoryRow(out, "document", array.size(), document);
+        printMemoryRow(out, "undo history", history.liveCount(), versions);
+        printMemoryRow(out, "packed history", packedVersions, packedHistory);
+        printMemoryRow(out, "clipboard", clipboard.size(), clipboardUsage);
+        printMemoryRow(out, "offset index", offsetIndex.isValid() ? array.size() : 0, indexUsage);
+        printMemoryRow(out, "total", 0, total);
+    }
+
+private:
+    static void printMemoryRow(std::ostream& out, const char* name, size_t items, const MemoryUsage& usage) {
+        out << std::left << std::setw(16) << name << std::right << std::setw(10) << items
+            << std::setw(14) << usage.live << std::setw(14) << usage.allocated << std::setw(12) << usage.overhead
+            << std::setw(14) << usage.total() << std::setw(10) << usage.blocks << std::endl;
+    }
+
+    template <typename OldLines, typename NewLines>
+    static void writeDiff(std::ostream& out, const OldLines& oldLines, const std::string& oldName,
+                          const NewLines& newLines, const std::string& newName) {
+        std::vector<LineChange> changes = LineDiff::compare(oldLines, newLines);
+        if (changes.empty()) {
+            out << "No differences." << std::endl;
+            return;
+        }
+        LineDiff::writeUnified(out, oldName, oldLines, newName, newLines, changes);
+    }
+
+    // UndoTree::visitLines hands a version over as a snapshot or as unpacked lines, so the
+    // visitors below take either. This one diffs the old side's lines against the version.
+    template <typename OldLines>
+    struct DiffToVersion {
+        std::ostream& out;
+        const OldLines& oldLines;
+        const std::string& oldName;
+        const std::string& newName;
+
+        template <typename NewLines>
+        void operator()(const NewLines& newLines) const {
+            writeDiff(out, oldLines, oldName, newLines, newName);
+        }
+    };
+
+    // Visits the `from` version of printVersionDiff, then the `to` one or the document.
+    struct VersionDiff {
+        const BasicStringArray& owner;
+        std::ostream& out;
+        size_t to;
+        LineViewList& toLines;
+        std::string fromName;
+        std::string toName;
+
+        template <typename OldLines>
+        void operator()(const OldLines& oldLines) const {
+            if (to == UndoTree<Store>::kNoVersion) {
+                writeDiff(out, oldLines, fromName, owner.array, toName);
+                return;
+            }
+            DiffToVersion<OldLines> next = {out, oldLines, fromName, toName};
+            owner.history.visitLines(to, toLines, next, next);
+        }
+    };
+};
+
+typedef BasicStringArray<VectorLineStore> StringArray;
+typedef BasicStringArray<CompactLineStore> CompactStringArray;
+typedef BasicStringArray<InternedLineStore> InternedStringArray;
+typedef BasicStringArray<PagedLineStore> PagedStringArray;
+
+#endif //HM2PP_STRING_ARRAY_H
@@ -0,0 +1,268 @@
+#ifndef HM2PP_TEXT_ENCODING_H
+#define HM2PP_TEXT_ENCODING_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include "Utf8.h"
+
+// How a text file is laid out on disk. Documents are always UTF-8 with lines split off their
+// terminators; loading records the file's form and saving writes it back the same way.
+struct TextFormat {
+    enum Encoding { kUtf8, kUtf16LE, kUtf16BE, kLatin1 };
+    enum LineEnding { kLF, kCRLF, kCR };
+
+    Encoding encoding;
+    LineEnding lineEnding;
+    bool byteOrderMark;
+    // The last line ends with a terminator.
+    bool finalNewline;
+
+    TextFormat() : encoding(kUtf8), lineEnding(kLF), byteOrderMark(false), finalNewline(true) {}
+
+    const char* newline() const {
+        return lineEnding == kCRLF ? "\r\n" : lineEnding == kCR ? "\r" : "\n";
+    }
+
+    size_t newlineBytes() const {
+        return lineEnding == kCRLF ? 2 : 1;
+    }
+
+    // Whether the last line, `lastLineBytes` long, is written with a terminator: always with a
+    // final newline, and without one when it is empty, since it would otherwise leave no trace
+    // in the file and not come back when the file is loaded.
+    bool terminatesLastLine(size_t lastLineBytes) const {
+        return finalNewline || lastLineBytes == 0;
+    }
+
+    // UTF-8 files hold the document's bytes unchanged, so file offsets follow from document
+    // offsets by arithmetic.
+    bool isUtf8() const {
+        return encoding == kUtf8;
+    }
+
+    size_t byteOrderMarkBytes() const {
+        return !byteOrderMark ? 0 : encoding == kUtf8 ? 3 : 2;
+    }
+
+    bool isDefault() const {
+        return encoding == kUtf8 && lineEnding == kLF && !byteOrderMark && finalNewline;
+    }
+
+    const char* encodingName() const {
+        static const char* names[] = {"UTF-8", "UTF-16LE", "UTF-16BE", "Latin-1"};
+        return names[encoding];
+    }
+
+    const char* lineEndingName() const {
+        static const char* names[] = {"LF", "CRLF", "CR"};
+        return names[lineEnding];
+    }
+
+    // For example "UTF-16LE with BOM, CRLF".
+    std::string describe() const {
+        std::string text = encodingName();
+        if (byteOrderMark) {
+            text += " with BOM";
+        }
+        text += ", ";
+        text += lineEndingName();
+        if (!finalNewline) {
+            text += ", no final newline";
+        }
+        return text;
+    }
+};
+
+// Looks at the start of a file: a byte order mark decides the encoding outright; otherwise
+// text with NUL bytes on one side of most code units is UTF-16, text that breaks UTF-8 early
+// on is Latin-1, and everything else is UTF-8. Sets `bomBytes` to the mark's length.
+inline TextFormat::Encoding detectEncoding(const char* data, size_t size, size_t& bomBytes) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    bomBytes = 0;
+    if (size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) {
+        bomBytes = 3;
+        return TextFormat::kUtf8;
+    }
+    if (size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE) {
+        bomBytes = 2;
+        return TextFormat::kUtf16LE;
+    }
+    if (size >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF) {
+        bomBytes = 2;
+        return TextFormat::kUtf16BE;
+    }
+
+    size_t sample = std::min<size_t>(size, 4096) & ~static_cast<size_t>(1);
+    size_t evenZeros = 0;
+    size_t oddZeros = 0;
+    for (size_t i = 0; i < sample; i += 2) {
+        evenZeros += bytes[i] == 0;
+        oddZeros += bytes[i + 1] == 0;
+    }
+    size_t units = sample / 2;
+    if (units != 0 && oddZeros * 5 >= units * 2 && evenZeros * 20 < units) {
+        return TextFormat::kUtf16LE;
+    }
+    if (units != 0 && evenZeros * 5 >= units * 2 && oddZeros * 20 < units) {
+        return TextFormat::kUtf16BE;
+    }
+
+    // A sequence cut off by the end of the sample is not an error.
+    size_t checked = std::min<size_t>(size, 64 * 1024);
+    size_t valid = validateUtf8(data, checked);
+    return valid + 4 <= checked || (checked == size && valid != size) ? TextFormat::kLatin1 : TextFormat::kUtf8;
+}
+
+inline void appendCodepoint(std::string& out, uint32_t codepoint) {
+    if (codepoint < 0x80) {
+        out.push_back(static_cast<char>(codepoint));
+    } else if (codepoint < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else if (codepoint < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    }
+}
+
+// Next codepoint of UTF-8 text at `position`, which it advances; malformed bytes decode to
+// U+FFFD one at a time.
+inline uint32_t decodeUtf8(const char* data, size_t size, size_t& position) {
+    size_t start = position;
+    unsigned char lead = static_cast<unsigned char>(data[start]);
+    if (lead < 0x80) {
+        position++;
+        return lead;
+    }
+    size_t length = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2;
+    if (length > size - start || validateUtf8(data + start, length) != length) {
+        position++;
+        return 0xFFFD;
+    }
+    uint32_t codepoint = lead & (0x7F >> length);
+    for (size_t i = 1; i < length; i++) {
+        codepoint = (codepoint << 6) | (static_cast<unsigned char>(data[start + i]) & 0x3F);
+    }
+    position += length;
+    return codepoint;
+}
+
+// Appends Latin-1 bytes as UTF-8; runs of ASCII are copied a block at a time.
+inline void appendLatin1AsUtf8(std::string& out, const char* data, size_t size) {
+    size_t i = 0;
+    while (i < size) {
+        size_t run = i;
+        while (run + 16 <= size && isAsciiBlock(data + run)) {
+            run += 16;
+        }
+        while (run < size && static_cast<unsigned char>(data[run]) < 0x80) {
+            run++;
+        }
+        out.append(data + i, run - i);
+        if (run < size) {
+            appendCodepoint(out, static_cast<unsigned char>(data[run]));
+            run++;
+        }
+        i = run;
+    }
+}
+
+// Appends UTF-8 text as Latin-1. Characters Latin-1 lacks become '?'; returns their number.
+inline size_t appendUtf8AsLatin1(std::string& out, const char* data, size_t size) {
+    size_t lost = 0;
+    size_t i = 0;
+    while (i < size) {
+        size_t run = i;
+        while (run + 16 <= size && isAsciiBlock(data + run)) {
+            run += 16;
+        }
+        while (run < size && static_cast<unsigned char>(data[run]) < 0x80) {
+            run++;
+        }
+        out.append(data + i, run - i);
+        if (run < size) {
+            uint32_t codepoint = decodeUtf8(data, size, run);
+            if (codepoint > 0xFF) {
+                out.push_back('?');
+                lost++;
+            } else {
+                out.push_back(static_cast<char>(codepoint));
+            }
+        }
+        i = run;
+    }
+    return lost;
+}
+
+// Appends UTF-16 as UTF-8 and returns how many bytes it used: a trailing odd byte or a high
+// surrogate whose pair has not arrived yet is left for the next call unless `atEnd`. Unpaired
+// surrogates become U+FFFD.
+inline size_t appendUtf16AsUtf8(std::string& out, const char* data, size_t size, bool bigEndian, bool atEnd) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    while (i + 2 <= size) {
+        uint32_t unit = bigEndian ? (bytes[i] << 8 | bytes[i + 1]) : (bytes[i + 1] << 8 | bytes[i]);
+        if (unit < 0x80) {
+            out.push_back(static_cast<char>(unit));
+            i += 2;
+            continue;
+        }
+        if (unit >= 0xD800 && unit <= 0xDBFF) {
+            if (i + 4 > size) {
+                if (!atEnd) {
+                    break;
+                }
+                appendCodepoint(out, 0xFFFD);
+                i += 2;
+                continue;
+            }
+            uint32_t low = bigEndian ? (bytes[i + 2] << 8 | bytes[i + 3]) : (bytes[i + 3] << 8 | bytes[i + 2]);
+            if (low >= 0xDC00 && low <= 0xDFFF) {
+                appendCodepoint(out, 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00));
+                i += 4;
+                continue;
+            }
+            unit = 0xFFFD;
+        } else if (unit >= 0xDC00 && unit <= 0xDFFF) {
+            unit = 0xFFFD;
+        }
+        appendCodepoint(out, unit);
+        i += 2;
+    }
+    if (atEnd && i < size) {
+        appendCodepoint(out, 0xFFFD);
+        i = size;
+    }
+    return i;
+}
+
+inline void appendUtf16Unit(std::string& out, uint32_t unit, bool bigEndian) {
+    char high = static_cast<char>(unit >> 8);
+    char low = static_cast<char>(unit & 0xFF);
+    out.push_back(bigEndian ? high : low);
+    out.push_back(bigEndian ? low : high);
+}
+
+inline void appendUtf8AsUtf16(std::string& out, const char* data, size_t size, bool bigEndian) {
+    size_t i = 0;
+    while (i < size) {
+        uint32_t codepoint = decodeUtf8(data, size, i);
+        if (codepoint >= 0x10000) {
+            codepoint -= 0x10000;
+            appendUtf16Unit(out, 0xD800 + (codepoint >> 10), bigEndian);
+            appendUtf16Unit(out, 0xDC00 + (codepoint & 0x3FF), bigEndian);
+        } else {
+            appendUtf16Unit(out, codepoint, bigEndian);
+        }
+    }
+}
+
+#endif //HM2PP_TEXT_ENCODING_H
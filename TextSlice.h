@@ -0,0 +1,78 @@
+#ifndef HM2PP_TEXT_SLICE_H
+#define HM2PP_TEXT_SLICE_H
+
+#include <memory>
+#include <string>
+
+#include "LineView.h"
+#include "MemoryUsage.h"
+
+// Immutable run of text held by shared ownership. `owner` keeps the bytes alive: either a
+// private copy, or storage of a line store that is never written while it is referenced (an
+// interned line node). Copying a slice, or slicing it further, copies no text.
+class TextSlice {
+private:
+    std::shared_ptr<const void> owner;
+    const char* bytes;
+    size_t length;
+    bool shared;
+
+public:
+    TextSlice() : bytes(""), length(0), shared(false) {}
+
+    // `owner` must keep [data, data + size) alive and unchanged.
+    TextSlice(std::shared_ptr<const void> owner, const char* data, size_t size)
+        : owner(std::move(owner)), bytes(data), length(size), shared(true) {}
+
+    static TextSlice copy(const char* data, size_t size) {
+        if (size == 0) {
+            return TextSlice();
+        }
+        std::shared_ptr<const std::string> text = std::make_shared<const std::string>(data, size);
+        TextSlice slice(text, text->data(), size);
+        slice.shared = false;
+        return slice;
+    }
+
+    TextSlice slice(size_t position, size_t size) const {
+        TextSlice part = *this;
+        part.bytes = bytes + position;
+        part.length = size;
+        return part;
+    }
+
+    LineView view() const {
+        return LineView(bytes, length);
+    }
+
+    const char* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    bool empty() const {
+        return length == 0;
+    }
+
+    // True when the bytes belong to a line store rather than to the slice.
+    bool isShared() const {
+        return shared;
+    }
+
+    // Private copies only; shared bytes are reported by the store that owns them.
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        if (owner && !shared) {
+            const std::string* text = static_cast<const std::string*>(owner.get());
+            // make_shared puts the string and its reference counts in one block.
+            usage.addBlock(sizeof(std::string), sizeof(std::string) + 16);
+            usage.addString(*text);
+        }
+        return usage;
+    }
+};
+
+#endif //HM2PP_TEXT_SLICE_H
@@ -0,0 +1,448 @@
+#ifndef HM2PP_UNDO_TREE_H
+#define HM2PP_UNDO_TREE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "MemoryUsage.h"
+#include "OperationStats.h"
+#include "PackedLines.h"
+
+// Every version of a document the editor has been in, as a tree: an edit adds a child of the
+// current version, undo moves to the parent, redo to the child visited last. Edits after an
+// undo start a new branch instead of discarding the old one, and any version can be made
+// current directly.
+//
+// A version holds a whole store snapshot, so switching to it is one restore however far away
+// it is in the tree; stores that share structure between snapshots (interned lines, paged
+// blocks) make both the snapshots and the restores cost only what differs. Versions outside
+// the `hotVersions` most recently used are LZ-compressed, and with a version limit the
+// least recently used leaves (or an unbranched root) are dropped.
+//
+// Versions are named by ids that only ever grow, so an id that was listed, recorded or
+// journaled never comes to name another version; a dropped version's id stays invalid. The
+// node table is indexed by slots, which dropped versions hand on to new ones.
+template <typename Store>
+class UndoTree {
+public:
+    typedef typename Store::Snapshot Snapshot;
+
+    static const size_t kNoVersion = ~static_cast<size_t>(0);
+
+private:
+    // Links between versions are slots.
+    struct Version {
+        std::unique_ptr<Snapshot> snapshot;  // null while packed and once dropped
+        PackedLines packed;
+        size_t id;
+        size_t parent;
+        size_t redoChild;
+        std::vector<size_t> children;
+        uint64_t used;
+        bool hot;
+        bool live;
+
+        Version(size_t id, size_t parent)
+            : id(id), parent(parent), redoChild(kNoVersion), used(0), hot(false), live(true) {}
+    };
+
+    std::vector<Version> versions;
+    // Slot of every live version id.
+    std::unordered_map<size_t, size_t> slots;
+    size_t nextId;
+    size_t currentVersion;
+    size_t rootVersion;
+    size_t liveVersions;
+    size_t hotVersions;
+    size_t hotCount;
+    size_t versionLimit;
+    uint64_t tick;
+    // Versions in the order they were last used, with the tick of that use; entries whose tick
+    // is out of date were superseded by a later use.
+    std::deque<std::pair<size_t, uint64_t>> recent;
+    // Min-heap of (used, slot) for versions prune() may drop. Entries are added when a version is
+    // used or becomes removable, and checked when they surface: a stale one (the version was
+    // used again, dropped or gained children) is discarded.
+    std::vector<std::pair<uint64_t, size_t>> removable;
+    // Slots of dropped versions, reused by the next versions added.
+    std::vector<size_t> freeSlots;
+
+    size_t slotOf(size_t id) const {
+        return slots.find(id)->second;
+    }
+
+    size_t idOf(size_t slot) const {
+        return slot == kNoVersion ? kNoVersion : versions[slot].id;
+    }
+
+    bool isRemovable(size_t slot) const {
+        const Version& version = versions[slot];
+        return version.live && (version.children.empty() || (slot == rootVersion && version.children.size() == 1));
+    }
+
+    // Adds an entry for `slot`, or rebuilds the heap from the tree (which covers `slot`) once
+    // stale entries outnumber the versions.
+    void addRemovable(size_t slot) {
+        if (removable.size() < 2 * liveVersions + 64) {
+            removable.push_back(std::make_pair(versions[slot].used, slot));
+            std::push_heap(removable.begin(), removable.end(), std::greater<std::pair<uint64_t, size_t>>());
+            return;
+        }
+        removable.clear();
+        for (size_t other = 0; other < versions.size(); other++) {
+            if (isRemovable(other)) {
+                removable.push_back(std::make_pair(versions[other].used, other));
+            }
+        }
+        std::make_heap(removable.begin(), removable.end(), std::greater<std::pair<uint64_t, size_t>>());
+    }
+
+    // Marks a version as just used and packs whatever falls out of the hot window.
+    void touch(size_t slot) {
+        Version& version = versions[slot];
+        version.used = ++tick;
+        if (!version.hot) {
+            version.hot = true;
+            hotCount++;
+        }
+        recent.push_back(std::make_pair(slot, tick));
+        if (isRemovable(slot)) {
+            addRemovable(slot);
+        }
+        while (hotCount > hotVersions) {
+            std::pair<size_t, uint64_t> oldest = recent.front();
+            recent.pop_front();
+            Version& candidate = versions[oldest.first];
+            if (!candidate.live || !candidate.hot || candidate.used != oldest.second) {
+                continue;
+            }
+            candidate.hot = false;
+            hotCount--;
+            pack(candidate);
+        }
+        if (recent.size() > 4 * hotVersions + 64) {
+            std::deque<std::pair<size_t, uint64_t>> current;
+            for (const std::pair<size_t, uint64_t>& entry : recent) {
+                const Version& candidate = versions[entry.first];
+                if (candidate.live && candidate.hot && candidate.used == entry.second) {
+                    current.push_back(entry);
+                }
+            }
+            recent.swap(current);
+        }
+    }
+
+    // Snapshots that hold less memory than their text (interned lines, paged blocks) are left
+    // alone, and a packed copy is kept only when it is smaller than the snapshot.
+    static void pack(Version& version) {
+        if (!version.snapshot || version.snapshot->memoryUsage().total() < version.snapshot->textBytes()) {
+            return;
+        }
+        static OperationStats& stats = StatsRegistry::operation("UndoTree::pack");
+        ScopedOperation timer(stats);
+        PackedLines packed;
+        packed.pack(*version.snapshot);
+        if (packed.memoryUsage().total() < version.snapshot->memoryUsage().total()) {
+            timer.addBytes(version.snapshot->memoryUsage().live);
+            version.packed = std::move(packed);
+            version.snapshot.reset();
+        }
+    }
+
+    void drop(size_t slot) {
+        Version& version = versions[slot];
+        if (version.hot) {
+            hotCount--;
+        }
+        version.snapshot.reset();
+        version.packed.clear();
+        std::vector<size_t>().swap(version.children);
+        version.hot = false;
+        version.live = false;
+        liveVersions--;
+        slots.erase(version.id);
+        freeSlots.push_back(slot);
+    }
+
+    // Adds a child of slot `parent` under the next id; returns its slot.
+    size_t appendVersion(size_t parent) {
+        size_t slot;
+        if (freeSlots.empty()) {
+            slot = versions.size();
+            versions.push_back(Version(nextId, parent));
+        } else {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+            versions[slot] = Version(nextId, parent);
+        }
+        slots[nextId++] = slot;
+        versions[parent].children.push_back(slot);
+        versions[parent].redoChild = slot;
+        liveVersions++;
+        addRemovable(slot);
+        return slot;
+    }
+
+    // Drops least recently used versions until the limit holds. Only leaves other than the
+    // current version, and the root while it has a single child, can go, so every remaining
+    // version still connects to the current one. Each drop costs O(log versions).
+    void prune() {
+        const std::greater<std::pair<uint64_t, size_t>> later;
+        bool currentSetAside = false;
+        while (versionLimit != 0 && liveVersions > versionLimit && !removable.empty()) {
+            std::pop_heap(removable.begin(), removable.end(), later);
+            std::pair<uint64_t, size_t> entry = removable.back();
+            removable.pop_back();
+            size_t victim = entry.second;
+            if (!isRemovable(victim) || versions[victim].used != entry.first) {
+                continue;
+            }
+            if (victim == currentVersion) {
+                currentSetAside = true;
+                continue;
+            }
+            Version& version = versions[victim];
+            if (victim == rootVersion) {
+                rootVersion = version.children.front();
+                versions[rootVersion].parent = kNoVersion;
+                if (isRemovable(rootVersion)) {
+                    addRemovable(rootVersion);
+                }
+            } else {
+                size_t parentSlot = version.parent;
+                Version& parent = versions[parentSlot];
+                parent.children.erase(std::find(parent.children.begin(), parent.children.end(), victim));
+                if (parent.redoChild == victim) {
+                    parent.redoChild = parent.children.empty() ? kNoVersion : parent.children.back();
+                }
+                if (isRemovable(parentSlot)) {
+                    addRemovable(parentSlot);
+                }
+            }
+            drop(victim);
+        }
+        if (currentSetAside) {
+            addRemovable(currentVersion);
+        }
+    }
+
+public:
+    // Starts a tree whose only version is `root`.
+    explicit UndoTree(Snapshot&& root)
+        : nextId(1), currentVersion(0), rootVersion(0), liveVersions(0), hotVersions(16), hotCount(0), versionLimit(0),
+          tick(0) {
+        versions.push_back(Version(0, kNoVersion));
+        versions.back().snapshot.reset(new Snapshot(std::move(root)));
+        slots[0] = 0;
+        liveVersions = 1;
+        touch(0);
+    }
+
+    UndoTree(UndoTree&&) = default;
+    UndoTree& operator=(UndoTree&&) = default;
+
+    // Number of most recently used versions kept expanded; applies from the next use on.
+    void setHotVersions(size_t count) {
+        hotVersions = std::max<size_t>(count, 1);
+    }
+
+    size_t getHotVersions() const {
+        return hotVersions;
+    }
+
+    // Most versions kept, counted as versions whatever their size; 0 keeps all of them.
+    void setVersionLimit(size_t limit) {
+        versionLimit = limit;
+        prune();
+    }
+
+    size_t getVersionLimit() const {
+        return versionLimit;
+    }
+
+    // The rest of the interface names versions by id; every id passed in must be live.
+    size_t current() const {
+        return versions[currentVersion].id;
+    }
+
+    size_t root() const {
+        return versions[rootVersion].id;
+    }
+
+    // Ids given out so far are below nextVersionId(); the next version added gets it.
+    size_t nextVersionId() const {
+        return nextId;
+    }
+
+    size_t liveCount() const {
+        return liveVersions;
+    }
+
+    bool isLive(size_t id) const {
+        return slots.count(id) != 0;
+    }
+
+    size_t parent(size_t id) const {
+        return idOf(versions[slotOf(id)].parent);
+    }
+
+    size_t redoChild(size_t id) const {
+        return idOf(versions[slotOf(id)].redoChild);
+    }
+
+    std::vector<size_t> children(size_t id) const {
+        std::vector<size_t> ids;
+        for (size_t child : versions[slotOf(id)].children) {
+            ids.push_back(versions[child].id);
+        }
+        return ids;
+    }
+
+    bool isPacked(size_t id) const {
+        const Version& version = versions[slotOf(id)];
+        return !version.snapshot && !version.packed.empty();
+    }
+
+    // Adds the store's state as a new child of the current version and makes it current.
+    void push(const Store& store) {
+        size_t slot = appendVersion(currentVersion);
+        versions[slot].snapshot.reset(new Snapshot(store.snapshot()));
+        currentVersion = slot;
+        touch(slot);
+        prune();
+    }
+
+    // Overwrites the current version with the store's state (coalesced edits).
+    void replaceCurrent(const Store& store) {
+        Version& version = versions[currentVersion];
+        version.snapshot.reset(new Snapshot(store.snapshot()));
+        version.packed.clear();
+        touch(currentVersion);
+    }
+
+    // Makes `id` the current version and the store equal to it: a single restore, expanding
+    // the version first if it was packed. Redo from each ancestor then leads back towards it.
+    void restore(size_t id, Store& store) {
+        size_t slot = slotOf(id);
+        Version& version = versions[slot];
+        if (version.snapshot) {
+            store.restore(*version.snapshot);
+        } else {
+            LineViewList lines;
+            version.packed.unpack(lines);
+            store.assign(lines.views.data(), lines.views.size());
+            version.snapshot.reset(new Snapshot(store.snapshot()));
+            version.packed.clear();
+        }
+        for (size_t child = slot; versions[child].parent != kNoVersion; child = versions[child].parent) {
+            versions[versions[child].parent].redoChild = child;
+        }
+        currentVersion = slot;
+        touch(slot);
+    }
+
+    // Hands the lines of a version to visitSnapshot(const Snapshot&) or, for a packed one, to
+    // visitPacked(const LineViewList&) after unpacking it into `scratch`.
+    template <typename VisitSnapshot, typename VisitPacked>
+    void visitLines(size_t id, LineViewList& scratch, VisitSnapshot visitSnapshot, VisitPacked visitPacked) const {
+        const Version& version = versions[slotOf(id)];
+        if (version.snapshot) {
+            visitSnapshot(*version.snapshot);
+        } else {
+            version.packed.unpack(scratch);
+            visitPacked(scratch);
+        }
+    }
+
+    // Building a tree from a session file: versions must come parents first. Returns the id of
+    // the new version.
+    size_t addVersion(size_t parent, Snapshot&& snapshot) {
+        size_t slot = appendVersion(slotOf(parent));
+        versions[slot].snapshot.reset(new Snapshot(std::move(snapshot)));
+        return versions[slot].id;
+    }
+
+    template <typename Lines>
+    size_t addPackedVersion(size_t parent, const Lines& lines) {
+        size_t slot = appendVersion(slotOf(parent));
+        versions[slot].packed.pack(lines);
+        return versions[slot].id;
+    }
+
+    void setRedoChild(size_t id, size_t child) {
+        versions[slotOf(id)].redoChild = slotOf(child);
+    }
+
+    // Marks `id` current without touching any store (the caller already holds its state).
+    void setCurrent(size_t id) {
+        currentVersion = slotOf(id);
+        touch(currentVersion);
+    }
+
+    // Snapshots of expanded versions, including the node table.
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addVector(versions);
+        for (const Version& version : versions) {
+            usage.addVector(version.children);
+            if (version.snapshot) {
+                usage.addBlock(sizeof(Snapshot), sizeof(Snapshot));
+                usage += version.snapshot->memoryUsage();
+            }
+        }
+        usage.addBlock(recent.size() * sizeof(recent.front()), recent.size() * sizeof(recent.front()));
+        usage.addVector(removable);
+        usage.addVector(freeSlots);
+        // One hash node per live version: key, slot and the next pointer.
+        usage.addBlock(slots.size() * 3 * sizeof(size_t), slots.size() * 3 * sizeof(size_t));
+        usage.addBlock(slots.bucket_count() * sizeof(void*), slots.bucket_count() * sizeof(void*));
+        return usage;
+    }
+
+    MemoryUsage packedMemoryUsage(size_t& packedVersions) const {
+        MemoryUsage usage;
+        packedVersions = 0;
+        for (const Version& version : versions) {
+            if (!version.packed.empty()) {
+                usage += version.packed.memoryUsage();
+                packedVersions++;
+            }
+        }
+        return usage;
+    }
+
+    // One row per live version, by id: id, parent, children, and whether it is current or
+    // packed.
+    void print(std::ostream& out) const {
+        out << std::left << std::setw(10) << "version" << std::right << std::setw(10) << "parent" << std::setw(10)
+            << "children" << "  state" << std::endl;
+        std::vector<std::pair<size_t, size_t>> live(slots.begin(), slots.end());
+        std::sort(live.begin(), live.end());
+        for (const std::pair<size_t, size_t>& entry : live) {
+            const Version& version = versions[entry.second];
+            bool current = entry.second == currentVersion;
+            bool packed = !version.snapshot && !version.packed.empty();
+            out << std::left << std::setw(10) << version.id << std::right << std::setw(10);
+            if (version.parent == kNoVersion) {
+                out << "-";
+            } else {
+                out << idOf(version.parent);
+            }
+            out << std::setw(10) << version.children.size() << "  " << (current ? "current" : "")
+                << (packed ? (current ? ", packed" : "packed") : "") << std::endl;
+        }
+    }
+};
+
+template <typename Store>
+const size_t UndoTree<Store>::kNoVersion;
+
+#endif //HM2PP_UNDO_TREE_H
@@ -0,0 +1,196 @@
+#ifndef HM2PP_UTF8_H
+#define HM2PP_UTF8_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "LineView.h"
+#include "MemoryUsage.h"
+
+// UTF-8 helpers. The scans work 16 bytes at a time with SSE2 or NEON where the target has them
+// (both are baseline on x86-64 and AArch64, so no extra compiler flags are needed), and byte by
+// byte otherwise. A codepoint starts at every byte that is not a continuation byte
+// (10xxxxxx); invalid text therefore still has well-defined columns.
+
+inline bool isAsciiBlock(const char* data) {
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data))) == 0;
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    return vmaxvq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(data))) < 0x80;
+#else
+    for (size_t i = 0; i < 16; i++) {
+        if (static_cast<unsigned char>(data[i]) >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+// Number of codepoint starts among 16 bytes.
+inline size_t countBlockCodepoints(const char* data) {
+#if defined(__SSE2__)
+    // Continuation bytes 0x80-0xBF are the signed bytes below -64.
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    int continuation = _mm_movemask_epi8(_mm_cmplt_epi8(block, _mm_set1_epi8(-64)));
+    return 16 - static_cast<size_t>(__builtin_popcount(static_cast<unsigned>(continuation)));
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    uint8x16_t continuation = vcltq_s8(vld1q_s8(reinterpret_cast<const int8_t*>(data)), vdupq_n_s8(-64));
+    return 16 - vaddvq_u8(vshrq_n_u8(continuation, 7));
+#else
+    size_t count = 0;
+    for (size_t i = 0; i < 16; i++) {
+        count += (static_cast<unsigned char>(data[i]) & 0xC0) != 0x80;
+    }
+    return count;
+#endif
+}
+
+inline bool isAscii(const char* data, size_t size) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        if (!isAsciiBlock(data + i)) {
+            return false;
+        }
+    }
+    for (; i < size; i++) {
+        if (static_cast<unsigned char>(data[i]) >= 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Offset of the first byte that does not belong to a well-formed UTF-8 sequence (RFC 3629: no
+// overlong forms, surrogates or values past U+10FFFF), or `size` if there is none. Runs of ASCII
+// are skipped a block at a time, so mostly-ASCII text costs little more than a memory scan.
+inline size_t validateUtf8(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    while (i < size) {
+        if (i + 16 <= size && isAsciiBlock(data + i)) {
+            i += 16;
+            continue;
+        }
+        unsigned char lead = bytes[i];
+        if (lead < 0x80) {
+            i++;
+            continue;
+        }
+        size_t length;
+        unsigned char low = 0x80;
+        unsigned char high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            low = lead == 0xE0 ? 0xA0 : 0x80;
+            high = lead == 0xED ? 0x9F : 0xBF;
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            low = lead == 0xF0 ? 0x90 : 0x80;
+            high = lead == 0xF4 ? 0x8F : 0xBF;
+        } else {
+            return i;
+        }
+        if (length > size - i || bytes[i + 1] < low || bytes[i + 1] > high) {
+            return i;
+        }
+        for (size_t k = 2; k < length; k++) {
+            if ((bytes[i + k] & 0xC0) != 0x80) {
+                return i;
+            }
+        }
+        i += length;
+    }
+    return size;
+}
+
+inline size_t countCodepoints(const char* data, size_t size) {
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        count += countBlockCodepoints(data + i);
+    }
+    for (; i < size; i++) {
+        count += (static_cast<unsigned char>(data[i]) & 0xC0) != 0x80;
+    }
+    return count;
+}
+
+// Byte offset of the `count`-th codepoint after byte `start`, `size` when that is the end of the
+// text, or npos past it.
+inline size_t advanceCodepoints(const char* data, size_t size, size_t start, uint64_t count) {
+    size_t i = start;
+    for (; i + 16 <= size; i += 16) {
+        size_t block = countBlockCodepoints(data + i);
+        if (block > count) {
+            break;
+        }
+        count -= block;
+    }
+    for (; i <= size; i++) {
+        if (i == size || (static_cast<unsigned char>(data[i]) & 0xC0) != 0x80) {
+            if (count == 0) {
+                return i;
+            }
+            count--;
+        }
+    }
+    return std::string::npos;
+}
+
+// Codepoint columns of one line: the byte offset of every kStride-th codepoint, so a column
+// converts to a byte offset with a bounded scan and back with a binary search. Valid until the
+// line changes.
+class Utf8Columns {
+private:
+    std::vector<size_t> checkpoints;
+
+public:
+    static const size_t kStride = 64;
+
+    explicit Utf8Columns(LineView line) {
+        size_t i = 0;
+        while (i < line.size) {
+            checkpoints.push_back(i);
+            i = advanceCodepoints(line.data, line.size, i, kStride);
+        }
+    }
+
+    // Byte offset of codepoint `column`; line.size for the end of the line, npos past it.
+    size_t byteColumn(LineView line, uint64_t column) const {
+        if (checkpoints.empty()) {
+            return advanceCodepoints(line.data, line.size, 0, column);
+        }
+        size_t checkpoint = static_cast<size_t>(std::min<uint64_t>(column / kStride, checkpoints.size() - 1));
+        return advanceCodepoints(line.data, line.size, checkpoints[checkpoint], column - checkpoint * kStride);
+    }
+
+    // Codepoints before byte `position`.
+    uint64_t codepointColumn(LineView line, size_t position) const {
+        size_t next = std::upper_bound(checkpoints.begin(), checkpoints.end(), position) - checkpoints.begin();
+        if (next == 0) {
+            return countCodepoints(line.data, position);
+        }
+        size_t start = checkpoints[next - 1];
+        return (next - 1) * kStride + countCodepoints(line.data + start, position - start);
+    }
+
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addVector(checkpoints);
+        return usage;
+    }
+};
+
+#endif //HM2PP_UTF8_H
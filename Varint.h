@@ -0,0 +1,28 @@
+#ifndef HM2PP_VARINT_H
+#define HM2PP_VARINT_H
+
+#include <cstdint>
+#include <string>
+
+// LEB128 variable-length integers: seven bits per byte, high bit set on all but the last.
+inline void appendVarint(std::string& out, uint64_t value) {
+    do {
+        char byte = static_cast<char>(value & 0x7F);
+        value >>= 7;
+        out.push_back(static_cast<char>(byte | (value ? 0x80 : 0)));
+    } while (value);
+}
+
+inline bool readVarint(const char*& cursor, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && cursor != end; shift += 7) {
+        unsigned char byte = static_cast<unsigned char>(*cursor++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif //HM2PP_VARINT_H
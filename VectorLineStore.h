@@ -0,0 +1,185 @@
+#ifndef HM2PP_VECTOR_LINE_STORE_H
+#define HM2PP_VECTOR_LINE_STORE_H
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Arena.h"
+#include "LineView.h"
+#include "MemoryUsage.h"
+#include "TextSlice.h"
+
+// Immutable copy of the document used by the undo/redo stacks. All lines of a snapshot
+// live in one arena, so taking a snapshot costs a single block allocation and dropping
+// it (history eviction, redo reset, teardown) frees everything in bulk.
+class LineSnapshot {
+private:
+    std::unique_ptr<Arena> arena;
+    ArenaLines lines;
+
+    static size_t bytesNeeded(const std::vector<std::string>& source) {
+        size_t bytes = source.size() * sizeof(ArenaString) + alignof(ArenaString);
+        ArenaString probe{ArenaAllocator<char>(nullptr)};
+        for (const std::string& line : source) {
+            if (line.size() > probe.capacity()) {
+                bytes += line.size() + 1 + alignof(std::max_align_t);
+            }
+        }
+        return bytes;
+    }
+
+public:
+    explicit LineSnapshot(const std::vector<std::string>& source)
+        : arena(new Arena(bytesNeeded(source))), lines(ArenaAllocator<ArenaString>(arena.get())) {
+        lines.reserve(source.size());
+        for (const std::string& line : source) {
+            lines.emplace_back(line.data(), line.size(), ArenaAllocator<char>(arena.get()));
+        }
+    }
+
+    LineSnapshot(LineSnapshot&&) = default;
+    // Not defaulted: the old lines must be destroyed while their arena is still alive, and
+    // the members are declared the other way round.
+    LineSnapshot& operator=(LineSnapshot&& other) noexcept {
+        lines = std::move(other.lines);
+        arena = std::move(other.arena);
+        return *this;
+    }
+
+    // Writes the snapshot back into `target`, reusing the capacity of its existing strings.
+    void restoreTo(std::vector<std::string>& target) const {
+        target.resize(lines.size());
+        for (size_t i = 0; i < lines.size(); i++) {
+            target[i].assign(lines[i].data(), lines[i].size());
+        }
+    }
+
+    size_t size() const {
+        return lines.size();
+    }
+
+    LineView line(size_t index) const {
+        return LineView(lines[index].data(), lines[index].size());
+    }
+
+    uint64_t textBytes() const {
+        uint64_t total = 0;
+        for (const ArenaString& line : lines) {
+            total += line.size();
+        }
+        return total;
+    }
+
+    size_t bytesReserved() const {
+        return arena->bytesReserved();
+    }
+
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addBlock(sizeof(Arena), sizeof(Arena));
+        usage += arena->memoryUsage();
+        return usage;
+    }
+};
+
+// Default line store: one std::string per line.
+class VectorLineStore {
+private:
+    std::vector<std::string> lines;
+
+public:
+    typedef LineSnapshot Snapshot;
+
+    size_t size() const {
+        return lines.size();
+    }
+
+    LineView line(size_t index) const {
+        return lines[index];
+    }
+
+    template <typename Edit>
+    void modify(size_t index, Edit edit) {
+        edit(lines[index]);
+    }
+
+    // Lines are edited in place, so the slice is a private copy.
+    TextSlice share(size_t index, size_t position, size_t length) const {
+        return TextSlice::copy(lines[index].data() + position, length);
+    }
+
+    void push_back(const char* data, size_t size) {
+        lines.emplace_back(data, size);
+    }
+
+    void push_back(const std::string& line) {
+        lines.push_back(line);
+    }
+
+    void push_back(std::string&& line) {
+        lines.push_back(std::move(line));
+    }
+
+    // Replaces lines [first, first + count) with `n` new ones. `data` must not point into the store.
+    void splice(size_t first, size_t count, const LineView* data, size_t n) {
+        size_t common = std::min(count, n);
+        for (size_t i = 0; i < common; i++) {
+            lines[first + i].assign(data[i].data, data[i].size);
+        }
+        if (count > n) {
+            lines.erase(lines.begin() + first + n, lines.begin() + first + count);
+        } else if (n > count) {
+            lines.insert(lines.begin() + first + count, n - count, std::string());
+            for (size_t i = count; i < n; i++) {
+                lines[first + i].assign(data[i].data, data[i].size);
+            }
+        }
+    }
+
+    void assign(const std::vector<std::string>& data) {
+        lines = data;
+    }
+
+    void assign(std::vector<std::string>&& data) {
+        lines = std::move(data);
+    }
+
+    void assign(const LineView* data, size_t count) {
+        lines.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            lines[i].assign(data[i].data, data[i].size);
+        }
+    }
+
+    std::vector<std::string> toVector() const {
+        return lines;
+    }
+
+    // Moves the lines out, leaving the store empty.
+    std::vector<std::string> release() {
+        std::vector<std::string> result;
+        result.swap(lines);
+        return result;
+    }
+
+    Snapshot snapshot() const {
+        return LineSnapshot(lines);
+    }
+
+    void restore(const Snapshot& snapshot) {
+        snapshot.restoreTo(lines);
+    }
+
+    MemoryUsage memoryUsage() const {
+        MemoryUsage usage;
+        usage.addVector(lines);
+        for (const std::string& line : lines) {
+            usage.addString(line);
+        }
+        return usage;
+    }
+};
+
+#endif //HM2PP_VECTOR_LINE_STORE_H
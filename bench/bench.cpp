@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "ConsoleMute.h"
+#include "FilesSL.h"
+#include "SearchFunctions.h"
+#include "StringArray.h"
+
+// Benchmarks every StringArray operation, search and file load/save for each line store,
+// across document sizes and line-length distributions.
+//
+// Usage: Hm2PP_bench [--sizes=1000,100000] [--stores=vector,compact,interned,paged]
+//                    [--distributions=short,long,mixed,repetitive] [--ops=N] [--seed=N]
+
+namespace {
+    struct BenchConfig {
+        std::vector<size_t> sizes;
+        std::vector<std::string> stores;
+        std::vector<std::string> distributions;
+        size_t ops;
+        unsigned seed;
+
+        BenchConfig() : sizes{1000, 100000}, stores{"vector", "compact", "interned", "paged"},
+                        distributions{"short", "long", "mixed", "repetitive"}, ops(0), seed(42) {}
+    };
+
+    struct Measurement {
+        size_t ops;
+        double seconds;
+        uint64_t bytes;
+        uint64_t allocations;
+        uint64_t allocatedBytes;
+    };
+
+    class Measure {
+    private:
+        std::chrono::steady_clock::time_point start;
+        uint64_t startAllocations;
+        uint64_t startBytes;
+        Measurement& result;
+
+    public:
+        explicit Measure(Measurement& result)
+            : start(std::chrono::steady_clock::now()), startAllocations(AllocationCounter::allocations()),
+              startBytes(AllocationCounter::bytesAllocated()), result(result) {}
+
+        ~Measure() {
+            result.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            result.allocations += AllocationCounter::allocations() - startAllocations;
+            result.allocatedBytes += AllocationCounter::bytesAllocated() - startBytes;
+        }
+    };
+
+    std::vector<std::string> split(const std::string& value) {
+        std::vector<std::string> parts;
+        std::stringstream stream(value);
+        std::string part;
+        while (std::getline(stream, part, ',')) {
+            if (!part.empty()) {
+                parts.push_back(part);
+            }
+        }
+        return parts;
+    }
+
+    std::string randomText(std::mt19937& rng, size_t length) {
+        static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789 .,:;=-_/[]";
+        std::string text(length, ' ');
+        for (size_t i = 0; i < length; i++) {
+            text[i] = alphabet[rng() % (sizeof(alphabet) - 1)];
+        }
+        return text;
+    }
+
+    std::vector<std::string> generateDocument(const std::string& distribution, size_t lineCount, std::mt19937& rng) {
+        std::vector<std::string> lines;
+        lines.reserve(lineCount);
+        std::vector<std::string> templates;
+        for (int i = 0; i < 64; i++) {
+            templates.push_back(randomText(rng, 20 + rng() % 61));
+        }
+        for (size_t i = 0; i < lineCount; i++) {
+            if (distribution == "long") {
+                lines.push_back(randomText(rng, 200 + rng() % 1801));
+            } else if (distribution == "mixed") {
+                lines.push_back(randomText(rng, rng() % 10 == 0 ? 200 + rng() % 1801 : 20 + rng() % 61));
+            } else if (distribution == "repetitive") {
+                lines.push_back(templates[rng() % templates.size()]);
+            } else {
+                lines.push_back(randomText(rng, 20 + rng() % 61));
+            }
+        }
+        return lines;
+    }
+
+    uint64_t documentBytes(const std::vector<std::string>& lines) {
+        uint64_t bytes = 0;
+        for (const std::string& line : lines) {
+            bytes += line.size() + 1;
+        }
+        return bytes;
+    }
+
+    void report(const std::string& store, const std::string& distribution, size_t lines,
+                const std::string& operation, const Measurement& m) {
+        double nsPerOp = m.ops ? m.seconds * 1e9 / m.ops : 0;
+        double opsPerSecond = m.seconds > 0 ? m.ops / m.seconds : 0;
+        std::cout << std::left << std::setw(10) << store << std::setw(12) << distribution
+                  << std::right << std::setw(9) << lines << "  " << std::left << std::setw(10) << operation
+                  << std::right << std::setw(7) << m.ops
+                  << std::fixed << std::setprecision(0) << std::setw(14) << nsPerOp
+                  << std::setw(13) << opsPerSecond;
+        if (m.bytes != 0 && m.seconds > 0) {
+            std::cout << std::setprecision(1) << std::setw(10) << m.bytes / m.seconds / (1024.0 * 1024.0);
+        } else {
+            std::cout << std::setw(10) << "-";
+        }
+        std::cout << std::setprecision(1) << std::setw(12) << (m.ops ? double(m.allocations) / m.ops : 0)
+                  << std::setprecision(0) << std::setw(12) << (m.ops ? double(m.allocatedBytes) / m.ops : 0)
+                  << std::endl;
+    }
+
+    int pickLine(const std::vector<std::string>& document, std::mt19937& rng) {
+        return static_cast<int>(rng() % document.size()) + 1;
+    }
+
+    template <typename Store, typename Edit>
+    Measurement timeEdits(const std::vector<std::string>& document, const std::vector<int>& targets, Edit edit) {
+        BasicStringArray<Store> array;
+        array.setStrings(document);
+        Measurement m = {targets.size(), 0, 0, 0, 0};
+        ConsoleMute mute;
+        for (int target : targets) {
+            Measure measure(m);
+            edit(array, target);
+        }
+        return m;
+    }
+
+    template <typename Store>
+    void benchDocument(const std::string& storeName, const std::string& distribution,
+                       const std::vector<std::string>& document, const BenchConfig& config, std::mt19937& rng) {
+        const size_t lines = document.size();
+        const uint64_t bytes = documentBytes(document);
+        const size_t editOps = config.ops ? config.ops : std::max<size_t>(4, std::min<size_t>(2000, 4000000 / lines));
+        const std::string fileName = "hm2pp_bench_document.txt";
+
+        {
+            std::ofstream file(fileName);
+            for (const std::string& line : document) {
+                file << line << '\n';
+            }
+        }
+
+        Store loaded;
+        Measurement load = {1, 0, bytes, 0, 0};
+        {
+            ConsoleMute mute;
+            Measure measure(load);
+            loaded = FilesSL::loadFromFile<Store>(fileName);
+        }
+        report(storeName, distribution, lines, "load", load);
+
+        BasicStringArray<Store> array;
+        array.setStore(std::move(loaded));
+
+        Measurement save = {1, 0, bytes, 0, 0};
+        {
+            ConsoleMute mute;
+            Measure measure(save);
+            array.saveToFile(fileName);
+        }
+        report(storeName, distribution, lines, "save", save);
+
+        Measurement search = {1, 0, bytes, 0, 0};
+        {
+            ConsoleMute mute;
+            Measure measure(search);
+            SearchFunctions::searchSubstringInArray(array.getStore(), "#not-present#");
+        }
+        report(storeName, distribution, lines, "search", search);
+
+        Measurement print = {1, 0, bytes, 0, 0};
+        {
+            ConsoleMute mute;
+            Measure measure(print);
+            array.printStrings();
+        }
+        report(storeName, distribution, lines, "print", print);
+
+        Measurement printPage = {editOps, 0, 0, 0, 0};
+        {
+            ConsoleMute mute;
+            for (size_t i = 0; i < editOps; i++) {
+                int first = pickLine(document, rng);
+                Measure measure(printPage);
+                array.printViewport(first, 50);
+            }
+        }
+        report(storeName, distribution, lines, "viewport", printPage);
+
+        // Each edit benchmark starts from a fresh document so history does not pile up across them.
+        std::vector<int> targets(editOps);
+        for (size_t i = 0; i < editOps; i++) {
+            targets[i] = pickLine(document, rng);
+        }
+
+        // Saves right after a single edit, into the file the full save above wrote: a same-length
+        // replacement is patched in place, an insertion rewrites from its line to the end.
+        Measurement patch = {editOps, 0, 0, 0, 0};
+        Measurement resave = {editOps, 0, 0, 0, 0};
+        {
+            ConsoleMute mute;
+            for (int target : targets) {
+                if (array.getStore().line(target - 1).size != 0) {
+                    array.insertSubstring(target, 0, "p", true);
+                }
+                Measure measure(patch);
+                array.saveToFile(fileName);
+            }
+            for (int target : targets) {
+                array.insertSubstring(target, 0, "r");
+                Measure measure(resave);
+                array.saveToFile(fileName);
+            }
+        }
+        report(storeName, distribution, lines, "patch", patch);
+        report(storeName, distribution, lines, "resave", resave);
+        std::remove(fileName.c_str());
+
+        report(storeName, distribution, lines, "append", timeEdits<Store>(document, targets,
+            [](BasicStringArray<Store>& a, int) { a.addString("appended"); }));
+        report(storeName, distribution, lines, "emptyline", timeEdits<Store>(document, targets,
+            [](BasicStringArray<Store>& a, int) { a.addEmptyLine(); }));
+        report(storeName, distribution, lines, "insert", timeEdits<Store>(document, targets,
+            [](BasicStringArray<Store>& a, int line) {
+                a.insertSubstring(line, static_cast<int>(a.getStore().line(line - 1).size / 2), "inserted");
+            }));
+        report(storeName, distribution, lines, "replace", timeEdits<Store>(document, targets,
+            [](BasicStringArray<Store>& a, int line) {
+                a.insertSubstring(line, static_cast<int>(a.getStore().line(line - 1).size / 2), "replaced", true);
+            }));
+        report(storeName, distribution, lines, "delete", timeEdits<Store>(document, targets,
+            [](BasicStringArray<Store>& a, int line) {
+                int size = static_cast<int>(a.getStore().line(line - 1).size);
+                a.deleteSubstring(line, size / 2, std::min(3, size - size / 2));
+            }));
+        report(storeName, distribution, lines, "cut", timeEdits<Store>(document, targets,
+            [](BasicStringArray<Store>& a, int line) {
+                int size = static_cast<int>(a.getStore().line(line - 1).size);
+                a.cut(line, size / 2, std::min(3, size - size / 2));
+            }));
+        report(storeName, distribution, lines, "copy", timeEdits<Store>(document, targets,
+            [](BasicStringArray<Store>& a, int line) {
+                int size = static_cast<int>(a.getStore().line(line - 1).size);
+                a.copy(line, 0, size);
+            }));
+        report(storeName, distribution, lines, "paste", timeEdits<Store>(document, targets,
+            [](BasicStringArray<Store>& a, int line) { a.paste(line, 0); }));
+
+        BasicStringArray<Store> history;
+        history.setStrings(document);
+        Measurement undo = {editOps, 0, 0, 0, 0};
+        Measurement redo = {editOps, 0, 0, 0, 0};
+        {
+            ConsoleMute mute;
+            for (size_t i = 0; i < editOps; i++) {
+                history.insertSubstring(targets[i], 0, "x");
+            }
+            for (size_t i = 0; i < editOps; i++) {
+                {
+                    Measure measure(undo);
+                    history.undo();
+                }
+                Measure measure(redo);
+                history.redo();
+            }
+        }
+        report(storeName, distribution, lines, "undo", undo);
+        report(storeName, distribution, lines, "redo", redo);
+
+        // Both documents now carry their own scattered edits.
+        Measurement diff = {1, 0, bytes, 0, 0};
+        {
+            ConsoleMute mute;
+            Measure measure(diff);
+            history.printDiff(std::cout, array.getStore(), "saved");
+        }
+        report(storeName, distribution, lines, "diff", diff);
+    }
+
+    template <typename Store>
+    void benchStore(const std::string& storeName, const BenchConfig& config) {
+        for (const std::string& distribution : config.distributions) {
+            for (size_t size : config.sizes) {
+                std::mt19937 rng(config.seed);
+                std::vector<std::string> document = generateDocument(distribution, size, rng);
+                benchDocument<Store>(storeName, distribution, document, config, rng);
+            }
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 8, "--sizes=") == 0) {
+            config.sizes.clear();
+            for (const std::string& size : split(arg.substr(8))) {
+                config.sizes.push_back(std::strtoull(size.c_str(), nullptr, 10));
+            }
+        } else if (arg.compare(0, 9, "--stores=") == 0) {
+            config.stores = split(arg.substr(9));
+        } else if (arg.compare(0, 16, "--distributions=") == 0) {
+            config.distributions = split(arg.substr(16));
+        } else if (arg.compare(0, 6, "--ops=") == 0) {
+            config.ops = std::strtoull(arg.substr(6).c_str(), nullptr, 10);
+        } else if (arg.compare(0, 7, "--seed=") == 0) {
+            config.seed = static_cast<unsigned>(std::strtoul(arg.substr(7).c_str(), nullptr, 10));
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << std::left << std::setw(10) << "store" << std::setw(12) << "lengths"
+              << std::right << std::setw(9) << "lines" << "  " << std::left << std::setw(10) << "operation"
+              << std::right << std::setw(7) << "ops" << std::setw(14) << "ns/op" << std::setw(13) << "ops/s"
+              << std::setw(10) << "MB/s" << std::setw(12) << "allocs/op" << std::setw(12) << "bytes/op" << std::endl;
+
+    for (const std::string& store : config.stores) {
+        if (store == "vector") {
+            benchStore<VectorLineStore>(store, config);
+        } else if (store == "compact") {
+            benchStore<CompactLineStore>(store, config);
+        } else if (store == "interned") {
+            benchStore<InternedLineStore>(store, config);
+        } else if (store == "paged") {
+            benchStore<PagedLineStore>(store, config);
+        } else {
+            std::cerr << "Unknown store: " << store << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
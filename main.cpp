@@ -1,245 +1,218 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
-#include <vector>
-#include <fstream>
-#include <stack>
+#include <limits>
+#include <memory>
 #include <string>
-
-class StringArray {
-private:
-    std::vector<std::string> array;
-    std::stack<std::vector<std::string>> historyStack;
-    std::stack<std::vector<std::string>> redoStack;
-    int consecutiveUndoCount;
-    std::string clipboard;
-
-public:
-    StringArray() : consecutiveUndoCount(0) {
-        historyStack.push(array);
-    }
-
-    std::vector<std::string> getStrings() const {
-        return array;
-    }
-
-    void setStrings(const std::vector<std::string>& data) {
-        array = data;
-    }
-
-    size_t getStringCount() const {
-        return array.size();
-    }
-
-    void addString(const std::string& buffer) {
-        if (!array.empty()) {
-            array.back() += buffer;
-        } else {
-            array.push_back(buffer);
+#include <vector>
+#include <cstdint>
+
+#include "StringArray.h"
+#include "EditorCommands.h"
+#include "EditJournal.h"
+#include "EditTrace.h"
+#include "ChromeTrace.h"
+
+// Prompts for the arguments of `command`. Returns false when input ends.
+template <typename Store>
+bool readArguments(const BasicStringArray<Store>& stringArray, EditCommand& request) {
+    switch (request.command) {
+        case 1: {
+            std::cout << "Write text to append: ";
+            std::getline(std::cin, request.text);
+            break;
         }
-        historyStack.push(array);
-        redoStack = std::stack<std::vector<std::string>>();
-        consecutiveUndoCount = 0;
-    }
-
-    void addEmptyLine() {
-        array.push_back("");
-        historyStack.push(array);
-        redoStack = std::stack<std::vector<std::string>>();
-        consecutiveUndoCount = 0;
-    }
-
-    void printStrings() {
-        for (size_t i = 0; i < array.size(); i++) {
-            std::cout << i + 1 << ": " << array[i] << std::endl;
+        case 4: {
+            std::cout << "Write file name to SAVE: ";
+            std::cin >> request.text;
+            break;
         }
-    }
-
-    void deleteSubstring(int lineIndex, int position, int length) {
-        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size()) {
-            std::cerr << "Invalid line index." << std::endl;
-            return;
+        case 5: {
+            std::cout << "Write file name to LOAD: ";
+            std::cin >> request.text;
+            break;
         }
-
-        std::string& line = array[lineIndex - 1];
-
-        if (position < 0 || static_cast<size_t>(position) >= line.length()) {
-            std::cerr << "Invalid position." << std::endl;
-            return;
+        case 6: {
+            std::cout << "Enter substring to search for: ";
+            std::cin >> request.text;
+            break;
         }
+        case 7: {
+            int lineIndex, position;
+            bool replaceMode;
 
-        if (length < 0 || static_cast<size_t>(position + length) > line.length()) {
-            std::cerr << "Invalid length." << std::endl;
-            return;
-        }
+            std::cout << "Enter line index for insertion: ";
+            std::cin >> lineIndex;
 
-        clipboard = line.substr(position, length);
-        line.erase(position, length);
-        historyStack.push(array);
-        redoStack = std::stack<std::vector<std::string>>();
-        consecutiveUndoCount = 0;
-    }
+            std::cout << "Enter position for insertion (0-" << stringArray.getStringCount() << "): ";
+            std::cin >> position;
 
-    void undo() {
-        if (historyStack.size() > 1 && consecutiveUndoCount < 3) {
-            redoStack.push(array);
-            historyStack.pop();
-            array = historyStack.top();
-            consecutiveUndoCount++;
-        }
-    }
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
-    void redo() {
-        if (!redoStack.empty()) {
-            historyStack.push(array);
-            array = redoStack.top();
-            redoStack.pop();
-            consecutiveUndoCount = 0;
-        }
-    }
+            std::cout << "Enter substring to insert: ";
+            std::getline(std::cin, request.text);
 
-    void insertSubstring(int lineIndex, int position, const std::string& substring, bool replace = false) {
-        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size()) {
-            std::cerr << "Invalid line index." << std::endl;
-            return;
-        }
+            std::cout << "Replace existing text (1 for yes, 0 for no): ";
+            std::cin >> replaceMode;
 
-        if (position < 0 || static_cast<size_t>(position) > array[lineIndex - 1].length()) {
-            std::cerr << "Invalid position." << std::endl;
-            return;
+            request.numbers = {lineIndex, position, replaceMode};
+            break;
         }
+        case 8: {
+            int lineIndex, position, length;
 
-        if (replace) {
-            int length = substring.length();
-            array[lineIndex - 1].erase(position, length);
-            array[lineIndex - 1].insert(position, substring);
-        } else {
-            array[lineIndex - 1].insert(position, substring);
+            std::cout << "Choose line, index, and number of symbols to delete: ";
+            std::cin >> lineIndex >> position >> length;
+            request.numbers = {lineIndex, position, length};
+            break;
         }
-
-        historyStack.push(array);
-        redoStack = std::stack<std::vector<std::string>>();
-        consecutiveUndoCount = 0;
-    }
-
-    void cut(int lineIndex, int position, int length) {
-        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size()) {
-            std::cerr << "Invalid line index." << std::endl;
-            return;
+        case 11: {
+            int cutLine, cutPos, cutLen;
+            std::cout << "Choose line, position, and length to cut: ";
+            std::cin >> cutLine >> cutPos >> cutLen;
+            request.numbers = {cutLine, cutPos, cutLen};
+            break;
         }
-
-        std::string& line = array[lineIndex - 1];
-
-        if (position < 0 || static_cast<size_t>(position) >= line.length()) {
-            std::cerr << "Invalid position." << std::endl;
-            return;
+        case 12: {
+            int copyLine, copyPos, copyLen;
+            std::cout << "Choose line, position, and length to copy: ";
+            std::cin >> copyLine >> copyPos >> copyLen;
+            request.numbers = {copyLine, copyPos, copyLen};
+            break;
         }
-
-        if (length < 0 || static_cast<size_t>(position + length) > line.length()) {
-            std::cerr << "Invalid length." << std::endl;
-            return;
+        case 13: {
+            int pasteLine, pastePos;
+            std::cout << "Choose line and position to paste: ";
+            std::cin >> pasteLine >> pastePos;
+            request.numbers = {pasteLine, pastePos};
+            break;
         }
-
-        clipboard = line.substr(position, length);
-        line.erase(position, length);
-        historyStack.push(array);
-        redoStack = std::stack<std::vector<std::string>>();
-        consecutiveUndoCount = 0;
-    }
-
-    void copy(int lineIndex, int position, int length) {
-        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size()) {
-            std::cerr << "Invalid line index." << std::endl;
-            return;
+        case 14: {
+            uint64_t offset;
+            std::cout << "Enter byte offset: ";
+            std::cin >> offset;
+            request.numbers = {static_cast<int64_t>(offset)};
+            break;
         }
-
-        const std::string& line = array[lineIndex - 1];
-
-        if (position < 0 || static_cast<size_t>(position) >= line.length()) {
-            std::cerr << "Invalid position." << std::endl;
-            return;
+        case 15: {
+            int lineIndex, position;
+            std::cout << "Choose line and position: ";
+            std::cin >> lineIndex >> position;
+            request.numbers = {lineIndex, position};
+            break;
         }
-
-        if (length < 0 || static_cast<size_t>(position + length) > line.length()) {
-            std::cerr << "Invalid length." << std::endl;
-            return;
+        case 16: {
+            int firstLine, lastLine;
+            std::cout << "Choose first and last line to print: ";
+            std::cin >> firstLine >> lastLine;
+            request.numbers = {firstLine, lastLine};
+            break;
         }
-
-        clipboard = line.substr(position, length);
-    }
-
-    void paste(int lineIndex, int position) {
-        if (lineIndex < 1 || static_cast<size_t>(lineIndex) > array.size()) {
-            std::cerr << "Invalid line index." << std::endl;
-            return;
+        case 17: {
+            int firstLine, height;
+            std::cout << "Choose first line and number of lines to print: ";
+            std::cin >> firstLine >> height;
+            request.numbers = {firstLine, height};
+            break;
         }
-
-        if (position < 0 || static_cast<size_t>(position) > array[lineIndex - 1].length()) {
-            std::cerr << "Invalid position." << std::endl;
-            return;
+        case 19: {
+            std::cout << "Write file name for statistics: ";
+            std::cin >> request.text;
+            break;
         }
-
-        array[lineIndex - 1].insert(position, clipboard);
-        historyStack.push(array);
-        redoStack = std::stack<std::vector<std::string>>();
-        consecutiveUndoCount = 0;
-    }
-};
-
-class SearchFunctions {
-public:
-    static void searchSubstringInArray(const std::vector<std::string>& array, const std::string& substring) {
-        int foundCount = 0;
-
-        for (size_t i = 0; i < array.size(); i++) {
-            size_t found = array[i].find(substring);
-            if (found != std::string::npos) {
-                std::cout << "Substring found in line " << i + 1 << " at position " << found << ": " << substring << std::endl;
-                foundCount++;
-            }
+        case 21:
+        case 22: {
+            std::cout << "Write session file name: ";
+            std::cin >> request.text;
+            break;
         }
-
-        if (foundCount == 0) {
-            std::cout << "Substring not found in any line." << std::endl;
+        case 23: {
+            int pasteLine, pastePos, pasteRegister;
+            std::cout << "Choose line, position, and clipboard register (1 = most recent) to paste: ";
+            std::cin >> pasteLine >> pastePos >> pasteRegister;
+            request.numbers = {pasteLine, pastePos, pasteRegister};
+            break;
         }
-    }
-};
-
-class FilesSL {
-public:
-    static void saveToFile(const std::string& fileName, const std::vector<std::string>& data) {
-        std::ofstream file(fileName);
-        if (file.is_open()) {
-            for (const std::string& line : data) {
-                file << line << std::endl;
-            }
-            file.close();
-            std::cout << "Array saved to " << fileName << std::endl;
-        } else {
-            std::cerr << "Error opening the file." << std::endl;
+        case 25:
+        case 26:
+        case 27: {
+            int firstLine, firstPos, lastLine, lastPos;
+            std::cout << "Choose first line and position, then last line and position (exclusive) to "
+                      << (request.command == 25 ? "cut" : request.command == 26 ? "copy" : "delete") << ": ";
+            std::cin >> firstLine >> firstPos >> lastLine >> lastPos;
+            request.numbers = {firstLine, firstPos, lastLine, lastPos};
+            break;
         }
-    }
-
-    static std::vector<std::string> loadFromFile(const std::string& fileName) {
-        std::vector<std::string> loadedData;
-        std::ifstream file(fileName);
-        if (file.is_open()) {
+        case 31: {
+            int lineIndex;
+            std::cout << "Enter line index to insert before (" << stringArray.getStringCount() + 1 << " appends): ";
+            std::cin >> lineIndex;
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            std::cout << "Enter lines, then a line with a single '.': ";
             std::string line;
-            while (std::getline(file, line)) {
-                loadedData.push_back(line);
+            while (std::getline(std::cin, line) && line != ".") {
+                request.text += line;
+                request.text.push_back('\n');
             }
-            file.close();
-            std::cout << "Array loaded from " << fileName << std::endl;
-        } else {
-            std::cerr << "Error opening the file." << std::endl;
+            request.numbers = {lineIndex};
+            break;
+        }
+        case 33: {
+            int version;
+            std::cout << "Choose version (see command 32): ";
+            std::cin >> version;
+            request.numbers = {version};
+            break;
         }
-        return loadedData;
+        case 34: {
+            std::cout << "Write file name to compare with: ";
+            std::cin >> request.text;
+            break;
+        }
+        case 35: {
+            int from, to;
+            std::cout << "Choose version to compare, then a second version or -1 for the document: ";
+            std::cin >> from >> to;
+            request.numbers = {from, to};
+            break;
+        }
+        default:
+            break;
     }
-};
+    return static_cast<bool>(std::cin);
+}
 
+// Attaches the journal to a file that has just been loaded. When a crashed session left edits
+// in it, asks whether to replay them or start over from the file.
+template <typename Store>
+void attachJournal(EditJournal& journal, BasicStringArray<Store>& stringArray, const std::string& fileName) {
+    SessionSettings recoveredSettings;
+    std::vector<EditCommand> recovered =
+        journal.attach(fileName, journalCheckpoint(stringArray, false), recoveredSettings);
+    if (!EditJournal::hasEdits(recovered)) {
+        return;
+    }
+    int answer;
+    std::cout << "Found unsaved edits from a previous session in " << journal.path()
+              << ". Recover them (1 for yes, 0 for no): ";
+    if (!(std::cin >> answer)) {
+        // No answer: leave the journal for the next load.
+        journal.detach();
+    } else if (answer != 0) {
+        recoverJournal(journal, stringArray, recovered, recoveredSettings);
+        std::cout << "Recovered unsaved edits from " << journal.path() << std::endl;
+    } else {
+        journal.restart(journalCheckpoint(stringArray, false));
+    }
+}
 
-int main() {
+template <typename Store>
+void runEditor(TraceWriter* recorder, EditJournal* journal, const SessionSettings& settings) {
     int command = 0;
-    StringArray stringArray;
-    std::string fileName;
+    BasicStringArray<Store> stringArray;
+    applySettings(stringArray, settings);
+    std::chrono::steady_clock::time_point sessionStart = std::chrono::steady_clock::now();
     std::cout << "Commands:\n"
                  "1 - Append text\n"
                  "2 - Add empty line\n"
@@ -253,115 +226,129 @@ int main() {
                  "10 - Redo\n"
                  "11 - Cut\n"
                  "12 - Copy\n"
-                 "13 - Paste\n";
+                 "13 - Paste\n"
+                 "14 - Find line and position of byte offset\n"
+                 "15 - Find byte offset of line and position\n"
+                 "16 - Print lines from A to B\n"
+                 "17 - Print N lines starting at line A\n"
+                 "18 - Show operation statistics\n"
+                 "19 - Save operation statistics as JSON\n"
+                 "20 - Show memory usage\n"
+                 "21 - Save session (text and undo history)\n"
+                 "22 - Restore session\n"
+                 "23 - Paste from clipboard register\n"
+                 "24 - Show clipboard registers\n"
+                 "25 - Cut a range of lines\n"
+                 "26 - Copy a range of lines\n"
+                 "27 - Delete a range of lines\n"
+                 "28 - Begin transaction\n"
+                 "29 - Commit transaction (one undo step)\n"
+                 "30 - Roll back transaction\n"
+                 "31 - Insert lines\n"
+                 "32 - Show undo tree versions\n"
+                 "33 - Go to undo tree version\n"
+                 "34 - Show changes against a file\n"
+                 "35 - Show changes between undo tree versions\n";
 
     while (true) {
-        std::cout << "Write command 1-13: ";
-        std::cin >> command;
+        std::cout << "Write command 1-35: ";
+        if (!(std::cin >> command)) {
+            break;
+        }
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
-        switch (command) {
-            case 1: {
-                std::string buffer;
-                std::cout << "Write text to append: ";
-                std::getline(std::cin, buffer);
-                stringArray.addString(buffer);
-                break;
-            }
-            case 2: {
-                stringArray.addEmptyLine();
-                break;
-            }
-            case 3: {
-                stringArray.printStrings();
-                break;
-            }
-            case 4: {
-                std::cout << "Write file name to SAVE: ";
-                std::cin >> fileName;
-                FilesSL::saveToFile(fileName, stringArray.getStrings());
-                break;
-            }
-            case 5: {
-                std::cout << "Write file name to LOAD: ";
-                std::cin >> fileName;
-                stringArray.setStrings(FilesSL::loadFromFile(fileName));
-                break;
-            }
-            case 6: {
-                std::string substring;
-
-                std::cout << "Enter substring to search for: ";
-                std::cin >> substring;
+        EditCommand request(command);
+        if (!readArguments(stringArray, request)) {
+            break;
+        }
 
-                SearchFunctions::searchSubstringInArray(stringArray.getStrings(), substring);
-                break;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool ok = executeCommand(stringArray, request);
+        if (journal && command == 5) {
+            // A failed load leaves an empty document, which the old journal does not apply to either.
+            if (ok) {
+                attachJournal(*journal, stringArray, request.text);
+            } else {
+                journal->discard();
             }
-            case 7: {
-                int lineIndex, position;
-                std::string substring;
-                bool replaceMode;
-
-                std::cout << "Enter line index for insertion: ";
-                std::cin >> lineIndex;
+        } else if (journal) {
+            journalCommand(*journal, stringArray, request, ok);
+        }
+        std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
-                std::cout << "Enter position for insertion (0-" << stringArray.getStringCount() << "): ";
-                std::cin >> position;
+        if (ChromeTrace::enabled()) {
+            ChromeTrace::complete(std::string("command ") + commandName(command), "command", start, end);
+        }
+        if (recorder) {
+            recorder->write(request,
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(start - sessionStart).count(),
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+    }
+    // Input ended: quitting gives up the unsaved edits, so nothing is left to recover.
+    if (journal) {
+        journal->discard();
+    }
+}
 
-                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+int main(int argc, char* argv[]) {
+    std::string store = "vector";
+    std::string traceFile;
+    std::string chromeTraceFile;
+    bool journaling = true;
+    SessionSettings settings;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 8, "--store=") == 0) {
+            store = arg.substr(8);
+        } else if (arg.compare(0, 9, "--record=") == 0) {
+            traceFile = arg.substr(9);
+        } else if (arg.compare(0, 15, "--chrome-trace=") == 0) {
+            chromeTraceFile = arg.substr(15);
+        } else if (arg.compare(0, 14, "--coalesce-ms=") == 0) {
+            settings.coalesceGap = std::chrono::milliseconds(std::max(0, std::atoi(arg.substr(14).c_str())));
+        } else if (arg.compare(0, 16, "--history-limit=") == 0) {
+            settings.historyLimit = static_cast<size_t>(std::max(0, std::atoi(arg.substr(16).c_str())));
+        } else if (arg == "--columns=codepoints") {
+            settings.codepointColumns = true;
+        } else if (arg == "--columns=bytes") {
+            settings.codepointColumns = false;
+        } else if (arg == "--no-journal") {
+            journaling = false;
+        }
+    }
 
-                std::cout << "Enter substring to insert: ";
-                std::getline(std::cin, substring);
+    if (!chromeTraceFile.empty() && !ChromeTrace::open(chromeTraceFile)) {
+        std::cerr << "Error opening the Chrome trace file." << std::endl;
+        return 1;
+    }
 
-                std::cout << "Replace existing text (1 for yes, 0 for no): ";
-                std::cin >> replaceMode;
+    std::unique_ptr<TraceWriter> recorder;
+    if (!traceFile.empty()) {
+        recorder.reset(new TraceWriter(traceFile, settings));
+        if (!recorder->isOpen()) {
+            std::cerr << "Error opening the trace file." << std::endl;
+            return 1;
+        }
+    }
 
-                stringArray.insertSubstring(lineIndex, position, substring, replaceMode);
-                break;
-            }
-            case 8: {
-                int lineIndex, position, length;
+    std::unique_ptr<EditJournal> journal;
+    if (journaling) {
+        journal.reset(new EditJournal(settings));
+    }
 
-                std::cout << "Choose line, index, and number of symbols to delete: ";
-                std::cin >> lineIndex >> position >> length;
-                stringArray.deleteSubstring(lineIndex, position, length);
-                break;
-            }
-            case 9: {
-                stringArray.undo();
-                break;
-            }
-            case 10: {
-                stringArray.redo();
-                break;
-            }
-            case 11: {
-                int cutLine, cutPos, cutLen;
-                std::cout << "Choose line, position, and length to cut: ";
-                std::cin >> cutLine >> cutPos >> cutLen;
-                stringArray.cut(cutLine, cutPos, cutLen);
-                break;
-            }
-            case 12: {
-                int copyLine, copyPos, copyLen;
-                std::cout << "Choose line, position, and length to copy: ";
-                std::cin >> copyLine >> copyPos >> copyLen;
-                stringArray.copy(copyLine, copyPos, copyLen);
-                break;
-            }
-            case 13: {
-                int pasteLine, pastePos;
-                std::cout << "Choose line and position to paste: ";
-                std::cin >> pasteLine >> pastePos;
-                stringArray.paste(pasteLine, pastePos);
-                break;
-            }
-            default: {
-                if (command < 0 || command > 13) {
-                    std::cout << "The command is not implemented." << std::endl;
-                }
-                break;
-            }
-        }
+    if (store == "compact") {
+        runEditor<CompactLineStore>(recorder.get(), journal.get(), settings);
+    } else if (store == "interned") {
+        runEditor<InternedLineStore>(recorder.get(), journal.get(), settings);
+    } else if (store == "paged") {
+        runEditor<PagedLineStore>(recorder.get(), journal.get(), settings);
+    } else if (store == "vector") {
+        runEditor<VectorLineStore>(recorder.get(), journal.get(), settings);
+    } else {
+        std::cerr << "Unknown store: " << store << " (expected vector, compact, interned or paged)" << std::endl;
+        return 1;
     }
+    ChromeTrace::close();
+    return 0;
 }
@@ -0,0 +1,35 @@
+#ifndef HM2PP_TESTS_CHECK_H
+#define HM2PP_TESTS_CHECK_H
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+// Minimal test support. The build defaults to Release, where assert() compiles to nothing, so
+// tests count failures with CHECK and main() returns checkFailures(). Failures go to std::clog,
+// which ConsoleMute leaves alone.
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                                  \
+    do {                                                                                                  \
+        if (!(condition)) {                                                                               \
+            std::clog << __FILE__ << ":" << __LINE__ << ": CHECK failed: " #condition << std::endl;       \
+            checkFailures()++;                                                                            \
+        }                                                                                                 \
+    } while (0)
+
+inline void writeTestFile(const std::string& fileName, const std::string& contents) {
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), contents.size());
+}
+
+inline std::string readTestFile(const std::string& fileName) {
+    std::ifstream file(fileName, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+#endif //HM2PP_TESTS_CHECK_H
@@ -0,0 +1,39 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "ConsoleMute.h"
+#include "StringArray.h"
+
+// Codepoint columns on a document larger than the paged store's block cache: converting a
+// column may rebuild the offset index, which reads every line and evicts the block a line
+// taken before it pointed into.
+
+namespace {
+    void testColumnsAfterRebuild() {
+        ConsoleMute mute;
+        // Two-byte characters, well past the default 256 cached 64 KiB blocks.
+        const std::string text = std::string(48, 'a') + "\xC3\xA9" + std::string(48, 'b');
+        std::vector<std::string> lines(200000, text);
+        BasicStringArray<PagedLineStore> document;
+        document.setCodepointColumns(true);
+
+        document.setStrings(lines);
+        uint64_t offset;
+        CHECK(document.positionToCodepointOffset(1, 60, offset) && offset == 60);
+
+        document.setStrings(lines);
+        int lineIndex, position;
+        CHECK(document.offsetToPosition(50, lineIndex, position) && lineIndex == 1 && position == 49);
+
+        document.setStrings(lines);
+        document.insertSubstring(1, 49, "X");
+        CHECK(document.getStrings()[0] == std::string(48, 'a') + "\xC3\xA9X" + std::string(48, 'b'));
+    }
+}
+
+int main() {
+    testColumnsAfterRebuild();
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "LineDiff.h"
+#include "VectorLineStore.h"
+
+// Line diff: compare() returns changes in order that turn the old document into the new one,
+// with the fewest changed lines while the search stays under its cost limit, and
+// writeUnified() prints them as diff -u does.
+
+namespace {
+    VectorLineStore document(const std::vector<std::string>& lines) {
+        VectorLineStore store;
+        store.assign(lines);
+        return store;
+    }
+
+    std::vector<std::string> split(const std::string& letters) {
+        std::vector<std::string> lines;
+        for (char letter : letters) {
+            lines.push_back(std::string(1, letter));
+        }
+        return lines;
+    }
+
+    // Whether the changes are ordered, apart, and rebuild `newLines` from `oldLines`.
+    bool rebuilds(const std::vector<std::string>& oldLines, const std::vector<std::string>& newLines,
+                  const std::vector<LineChange>& changes) {
+        std::vector<std::string> result;
+        size_t oldLine = 0;
+        size_t newLine = 0;
+        for (const LineChange& change : changes) {
+            if (change.oldFirst < oldLine || change.oldFirst - oldLine != change.newFirst - newLine ||
+                (change.oldCount == 0 && change.newCount == 0) || change.oldFirst + change.oldCount > oldLines.size() ||
+                change.newFirst + change.newCount > newLines.size()) {
+                return false;
+            }
+            result.insert(result.end(), oldLines.begin() + oldLine, oldLines.begin() + change.oldFirst);
+            result.insert(result.end(), newLines.begin() + change.newFirst,
+                          newLines.begin() + change.newFirst + change.newCount);
+            oldLine = change.oldFirst + change.oldCount;
+            newLine = change.newFirst + change.newCount;
+        }
+        result.insert(result.end(), oldLines.begin() + oldLine, oldLines.end());
+        return result == newLines;
+    }
+
+    size_t cost(const std::vector<LineChange>& changes) {
+        size_t lines = 0;
+        for (const LineChange& change : changes) {
+            lines += change.oldCount + change.newCount;
+        }
+        return lines;
+    }
+
+    // Lines deleted plus lines inserted by a shortest edit script, from the longest common
+    // subsequence.
+    size_t shortestCost(const std::vector<std::string>& oldLines, const std::vector<std::string>& newLines) {
+        std::vector<std::vector<size_t>> common(oldLines.size() + 1, std::vector<size_t>(newLines.size() + 1, 0));
+        for (size_t i = 1; i <= oldLines.size(); i++) {
+            for (size_t j = 1; j <= newLines.size(); j++) {
+                common[i][j] = oldLines[i - 1] == newLines[j - 1] ? common[i - 1][j - 1] + 1
+                                                                  : std::max(common[i - 1][j], common[i][j - 1]);
+            }
+        }
+        return oldLines.size() + newLines.size() - 2 * common[oldLines.size()][newLines.size()];
+    }
+
+    std::string unified(const std::vector<std::string>& oldLines, const std::vector<std::string>& newLines) {
+        VectorLineStore oldStore = document(oldLines);
+        VectorLineStore newStore = document(newLines);
+        std::ostringstream out;
+        LineDiff::writeUnified(out, "old", oldStore, "new", newStore, LineDiff::compare(oldStore, newStore));
+        return out.str();
+    }
+
+    // Myers' example: ABCABBA to CBABAC takes five edits.
+    void testShortestScript() {
+        std::vector<std::string> oldLines = split("ABCABBA");
+        std::vector<std::string> newLines = split("CBABAC");
+        std::vector<LineChange> changes = LineDiff::compare(document(oldLines), document(newLines));
+        CHECK(rebuilds(oldLines, newLines, changes));
+        CHECK(cost(changes) == 5);
+
+        CHECK(LineDiff::compare(document(oldLines), document(oldLines)).empty());
+        std::vector<LineChange> all = LineDiff::compare(document({}), document(newLines));
+        CHECK(all.size() == 1 && all[0].oldCount == 0 && all[0].newCount == newLines.size());
+        all = LineDiff::compare(document(oldLines), document({}));
+        CHECK(all.size() == 1 && all[0].oldCount == oldLines.size() && all[0].newCount == 0);
+    }
+
+    // Small random documents over a few distinct lines, so there is much to match; the search
+    // stays under its cost limit, so the script must be a shortest one.
+    void testRandomScripts() {
+        std::mt19937 random(50);
+        bool valid = true;
+        bool shortest = true;
+        for (int round = 0; round < 2000; round++) {
+            std::vector<std::string> oldLines(random() % 40);
+            std::vector<std::string> newLines(random() % 40);
+            for (std::string& line : oldLines) {
+                line = std::string(1, static_cast<char>('a' + random() % 4));
+            }
+            for (std::string& line : newLines) {
+                line = std::string(1, static_cast<char>('a' + random() % 4));
+            }
+            std::vector<LineChange> changes = LineDiff::compare(document(oldLines), document(newLines));
+            valid = valid && rebuilds(oldLines, newLines, changes);
+            shortest = shortest && cost(changes) == shortestCost(oldLines, newLines);
+        }
+        CHECK(valid);
+        CHECK(shortest);
+    }
+
+    // Documents far enough apart to hit the cost limit still get a script that rebuilds them.
+    void testLargeScripts() {
+        std::mt19937 random(5);
+        std::vector<std::string> oldLines(20000);
+        for (std::string& line : oldLines) {
+            line = "line " + std::to_string(random() % 5000);
+        }
+        std::vector<std::string> newLines = oldLines;
+        for (int edit = 0; edit < 3000; edit++) {
+            size_t at = random() % newLines.size();
+            if (random() % 2 == 0) {
+                newLines.erase(newLines.begin() + at);
+            } else {
+                newLines.insert(newLines.begin() + at, "new " + std::to_string(random() % 5000));
+            }
+        }
+        std::shuffle(newLines.begin() + 10000, newLines.begin() + 12000, random);
+        CHECK(rebuilds(oldLines, newLines, LineDiff::compare(document(oldLines), document(newLines))));
+    }
+
+    // Output byte for byte as GNU diff -u writes it (after its file name lines).
+    void testUnified() {
+        CHECK(unified(split("abc"), split("abc")).empty());
+        CHECK(unified({}, {"x", "y"}) == "--- old\n+++ new\n@@ -0,0 +1,2 @@\n+x\n+y\n");
+        CHECK(unified({"x"}, {}) == "--- old\n+++ new\n@@ -1 +0,0 @@\n-x\n");
+        CHECK(unified(split("abcdefgh"), split("abcdXfgh")) ==
+              "--- old\n+++ new\n@@ -2,7 +2,7 @@\n b\n c\n d\n-e\n+X\n f\n g\n h\n");
+        // Changes more than six lines apart get hunks of their own, closer ones share one.
+        CHECK(unified(split("abcdefghijklmnop"), split("aBcdefghijklmnoP")) ==
+              "--- old\n+++ new\n@@ -1,5 +1,5 @@\n a\n-b\n+B\n c\n d\n e\n"
+              "@@ -13,4 +13,4 @@\n m\n n\n o\n-p\n+P\n");
+        CHECK(unified(split("abcdefghij"), split("aBcdefghIj")) ==
+              "--- old\n+++ new\n@@ -1,10 +1,10 @@\n a\n-b\n+B\n c\n d\n e\n f\n g\n h\n-i\n+I\n j\n");
+        CHECK(unified(split("abc"), split("abxc")) == "--- old\n+++ new\n@@ -1,3 +1,4 @@\n a\n b\n+x\n c\n");
+    }
+}
+
+int main() {
+    testShortestScript();
+    testRandomScripts();
+    testLargeScripts();
+    testUnified();
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "ConsoleMute.h"
+#include "FilesSL.h"
+#include "StringArray.h"
+#include "VectorLineStore.h"
+
+// Loading detects a file's encoding and line ending, including when the first terminator is
+// cut by the end of a read block, and saving in the detected format writes the file back as
+// it was. Byte offsets are those of the UTF-8 file, byte order mark and line endings included.
+
+namespace {
+    const char* const kFile = "encoding_test.txt";
+    const char* const kCopy = "encoding_test_copy.txt";
+    const size_t kBlock = 1 << 20;
+
+    struct Loaded {
+        std::vector<std::string> lines;
+        TextFormat format;
+    };
+
+    Loaded load(const std::string& contents) {
+        ConsoleMute mute;
+        writeTestFile(kFile, contents);
+        VectorLineStore store;
+        Loaded loaded;
+        CHECK(FilesSL::loadFromFile(kFile, store, loaded.format));
+        loaded.lines = store.toVector();
+        std::remove(kFile);
+        return loaded;
+    }
+
+    std::string saved(const std::vector<std::string>& lines, const TextFormat& format) {
+        ConsoleMute mute;
+        VectorLineStore store;
+        store.assign(lines);
+        CHECK(FilesSL::saveToFile(kCopy, store, format));
+        std::string contents = readTestFile(kCopy);
+        std::remove(kCopy);
+        return contents;
+    }
+
+    // Loads `contents`, checks what was detected, and saves it back unchanged.
+    void checkFile(const std::string& contents, TextFormat::Encoding encoding, TextFormat::LineEnding ending,
+                   bool finalNewline, const std::vector<std::string>& lines) {
+        Loaded loaded = load(contents);
+        CHECK(loaded.format.encoding == encoding);
+        CHECK(loaded.format.lineEnding == ending);
+        CHECK(loaded.format.finalNewline == finalNewline);
+        CHECK(loaded.lines == lines);
+        CHECK(saved(loaded.lines, loaded.format) == contents);
+    }
+
+    void testSmallFiles() {
+        checkFile("a\nb\n", TextFormat::kUtf8, TextFormat::kLF, true, {"a", "b"});
+        checkFile("a\r\nb", TextFormat::kUtf8, TextFormat::kCRLF, false, {"a", "b"});
+        checkFile("a\rb\r", TextFormat::kUtf8, TextFormat::kCR, true, {"a", "b"});
+        checkFile("a\r", TextFormat::kUtf8, TextFormat::kCR, true, {"a"});
+        checkFile("\r", TextFormat::kUtf8, TextFormat::kCR, true, {""});
+        checkFile("\r\n", TextFormat::kUtf8, TextFormat::kCRLF, true, {""});
+        checkFile("no terminator", TextFormat::kUtf8, TextFormat::kLF, false, {"no terminator"});
+        checkFile("\xEF\xBB\xBFx\r\ny\r\n", TextFormat::kUtf8, TextFormat::kCRLF, true, {"x", "y"});
+        checkFile("caf\xE9\n\xFC" "ber\n", TextFormat::kLatin1, TextFormat::kLF, true, {"caf\xC3\xA9", "\xC3\xBC" "ber"});
+        checkFile(std::string("\xFF\xFEh\0i\0\r\0\n\0\xE9\0", 12), TextFormat::kUtf16LE, TextFormat::kCRLF, false,
+                  {"hi", "\xC3\xA9"});
+        checkFile(std::string("\xFE\xFF\0h\0i\0\r\0\xE9\0\r", 12), TextFormat::kUtf16BE, TextFormat::kCR, true,
+                  {"hi", "\xC3\xA9"});
+    }
+
+    // Lines ending in anything but the detected ending load clean and save with it.
+    void testMixedEndings() {
+        Loaded loaded = load("a\r\nb\nc\r\n");
+        CHECK(loaded.format.lineEnding == TextFormat::kCRLF);
+        CHECK(loaded.lines == std::vector<std::string>({"a", "b", "c"}));
+        CHECK(saved(loaded.lines, loaded.format) == "a\r\nb\r\nc\r\n");
+    }
+
+    // The first terminator at or past the end of the first block.
+    void testBlockBoundaries() {
+        const std::string head(kBlock - 1, 'x');
+        // A '\r' as the last byte of the block, then more CR lines.
+        checkFile(head + "\ry\r", TextFormat::kUtf8, TextFormat::kCR, true, {head, "y"});
+        // A "\r\n" split by the block end.
+        checkFile(head + "\r\ny\r\n", TextFormat::kUtf8, TextFormat::kCRLF, true, {head, "y"});
+        // A file of exactly one block that ends in its only '\r'.
+        checkFile(head + "\r", TextFormat::kUtf8, TextFormat::kCR, true, {head});
+        // No terminator in the first block at all.
+        const std::string longLine(kBlock + kBlock / 2, 'z');
+        checkFile(longLine + "\rend\r", TextFormat::kUtf8, TextFormat::kCR, true, {longLine, "end"});
+        checkFile(longLine + "\nend", TextFormat::kUtf8, TextFormat::kLF, false, {longLine, "end"});
+        // A CR file whose later terminator falls on the block boundary.
+        const std::string middle(kBlock - 3, 'm');
+        checkFile("a\r" + middle + "\rb\r", TextFormat::kUtf8, TextFormat::kCR, true, {"a", middle, "b"});
+        checkFile("a\r\n" + std::string(kBlock - 4, 'm') + "\r\nb\r\n", TextFormat::kUtf8, TextFormat::kCRLF, true,
+                  {"a", std::string(kBlock - 4, 'm'), "b"});
+    }
+
+    // Every byte of a loaded UTF-8 file that is not part of a line ending maps to the line and
+    // position holding it and back; bytes of a line ending map to the end of their line.
+    void checkOffsets(const std::string& contents, size_t prefixBytes) {
+        ConsoleMute mute;
+        writeTestFile(kFile, contents);
+        BasicStringArray<VectorLineStore> document;
+        CHECK(document.loadFromFile(kFile));
+        std::remove(kFile);
+        std::vector<std::string> lines = document.getStrings();
+        int lineIndex, position;
+        bool mapped = true;
+        for (size_t offset = 0; offset < prefixBytes; offset++) {
+            mapped = mapped && !document.offsetToPosition(offset, lineIndex, position);
+        }
+        for (size_t offset = prefixBytes; offset < contents.size(); offset++) {
+            uint64_t back;
+            mapped = mapped && document.offsetToPosition(offset, lineIndex, position);
+            const std::string& line = lines[lineIndex - 1];
+            if (contents[offset] == '\r' || contents[offset] == '\n') {
+                mapped = mapped && static_cast<size_t>(position) == line.size();
+            } else {
+                mapped = mapped && line[position] == contents[offset] &&
+                         document.positionToOffset(lineIndex, position, back) && back == offset;
+            }
+        }
+        CHECK(mapped);
+        // The end of a file without a final newline is the end of its last line.
+        char last = contents[contents.size() - 1];
+        size_t end = contents.size() + (last == '\r' || last == '\n' ? 0 : 1);
+        if (end != contents.size()) {
+            CHECK(document.offsetToPosition(contents.size(), lineIndex, position) &&
+                  static_cast<size_t>(lineIndex) == lines.size() && static_cast<size_t>(position) == lines.back().size());
+        }
+        CHECK(!document.offsetToPosition(end, lineIndex, position));
+    }
+
+    void testFileOffsets() {
+        ConsoleMute mute;
+        writeTestFile(kFile, "ab\r\ncd\r\n");
+        BasicStringArray<VectorLineStore> document;
+        CHECK(document.loadFromFile(kFile));
+        std::remove(kFile);
+        uint64_t offset;
+        int lineIndex, position;
+        CHECK(document.positionToOffset(2, 0, offset) && offset == 4);
+        CHECK(document.offsetToPosition(4, lineIndex, position) && lineIndex == 2 && position == 0);
+        CHECK(document.offsetToPosition(3, lineIndex, position) && lineIndex == 1 && position == 2);
+
+        checkOffsets("ab\r\ncd\r\n", 0);
+        checkOffsets("one\r\n\r\nthree\r\nfour", 0);
+        checkOffsets("\xEF\xBB\xBFone\ntwo\n", 3);
+        checkOffsets("\xEF\xBB\xBF\xC3\xA9t\xC3\xA9\r\n\r\nx\r\n", 3);
+        checkOffsets("a\rbb\r\rccc\r", 0);
+    }
+}
+
+int main() {
+    testSmallFiles();
+    testMixedEndings();
+    testBlockBoundaries();
+    testFileOffsets();
+    return checkFailures() == 0 ? 0 : 1;
+}
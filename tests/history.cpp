@@ -0,0 +1,210 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "ConsoleMute.h"
+#include "StringArray.h"
+
+// The undo tree as the editor uses it: a document loaded or replaced outside history stays
+// reachable by undo once it is edited, and a version limit drops the least recently used
+// versions without ever giving their ids to new ones.
+
+namespace {
+    const char* const kDocument = "history_test.txt";
+
+    // Load, edit, undo: the undo returns to the loaded text, and another undo to the document
+    // from before the load.
+    template <typename Store>
+    void testLoadThenEdit() {
+        ConsoleMute mute;
+        writeTestFile(kDocument, "loaded one\nloaded two\n");
+        BasicStringArray<Store> document;
+        document.addString("before");
+        CHECK(document.loadFromFile(kDocument));
+        std::vector<std::string> loaded = document.getStrings();
+
+        document.insertSubstring(1, 0, "edited ");
+        CHECK(document.getStrings()[0] == "edited loaded one");
+        document.undo();
+        CHECK(document.getStrings() == loaded);
+        document.undo();
+        CHECK(document.getStrings() == std::vector<std::string>({"before"}));
+        document.redo();
+        CHECK(document.getStrings() == loaded);
+        document.redo();
+        CHECK(document.getStrings()[0] == "edited loaded one");
+        std::remove(kDocument);
+    }
+
+    // Every kind of edit keeps a replaced document, including typing that would otherwise
+    // coalesce with the edit before the replacement and edits inside a transaction.
+    template <typename Store>
+    void testReplaceThenEdit() {
+        ConsoleMute mute;
+        const std::vector<std::string> replaced = {"alpha", "beta"};
+        BasicStringArray<Store> document;
+        document.setCoalescing(std::chrono::milliseconds(60000));
+        document.addString("typed");
+
+        document.setStrings(replaced);
+        document.addString(" more");
+        document.addString(" text");
+        CHECK(document.getStrings()[1] == "beta more text");
+        document.undo();
+        CHECK(document.getStrings() == replaced);
+
+        document.setStrings(replaced);
+        document.deleteSubstring(1, 0, 2);
+        document.undo();
+        CHECK(document.getStrings() == replaced);
+
+        document.setStrings(replaced);
+        document.cutRange(1, 2, 2, 1);
+        document.undo();
+        CHECK(document.getStrings() == replaced);
+
+        document.setStrings(replaced);
+        document.insertLines(1, std::vector<std::string>({"new"}));
+        document.undo();
+        CHECK(document.getStrings() == replaced);
+
+        document.setStrings(replaced);
+        CHECK(document.beginTransaction());
+        document.insertSubstring(2, 0, "x");
+        document.addEmptyLine();
+        CHECK(document.commitTransaction());
+        document.undo();
+        CHECK(document.getStrings() == replaced);
+    }
+
+    template <typename Store>
+    std::vector<std::string> contents(const Store& store) {
+        std::vector<std::string> lines;
+        for (size_t i = 0; i < store.size(); i++) {
+            lines.push_back(store.line(i).str());
+        }
+        return lines;
+    }
+
+    // Drops in least recently used order: the unbranched root first, then the leaf not used
+    // since it was added. New versions get new ids, and dropped ids stay invalid.
+    template <typename Store>
+    void testPruneOrder() {
+        Store store;
+        store.assign(std::vector<std::string>({"0"}));
+        UndoTree<Store> tree(store.snapshot());
+        tree.setVersionLimit(3);
+        for (const char* text : {"1", "2", "3"}) {
+            store.assign(std::vector<std::string>({text}));
+            tree.push(store);
+        }
+        CHECK(tree.liveCount() == 3);
+        CHECK(!tree.isLive(0));
+        CHECK(tree.root() == 1);
+        CHECK(tree.parent(1) == UndoTree<Store>::kNoVersion);
+
+        tree.restore(1, store);
+        store.assign(std::vector<std::string>({"4"}));
+        tree.push(store);
+        CHECK(tree.current() == 4);
+        CHECK(tree.parent(4) == 1);
+        CHECK(tree.nextVersionId() == 5);
+        CHECK(!tree.isLive(0) && !tree.isLive(3));
+        CHECK(tree.children(2).empty());
+        CHECK(tree.children(1) == std::vector<size_t>({2, 4}));
+        tree.restore(2, store);
+        CHECK(contents(store) == std::vector<std::string>({"2"}));
+        tree.restore(4, store);
+        CHECK(contents(store) == std::vector<std::string>({"4"}));
+    }
+
+    // goto refuses the id of a dropped version rather than landing on another one.
+    template <typename Store>
+    void testGotoDropped() {
+        ConsoleMute mute;
+        BasicStringArray<Store> document;
+        document.setHistoryLimit(2);
+        document.addString("a");
+        size_t first = document.currentVersion();
+        document.addString("b");
+        document.undo();
+        document.addString("c");
+        document.addString("d");
+        // "ab" and then "a" were dropped, and "ac" and "acd" came after them.
+        CHECK(document.currentVersion() == first + 3);
+        CHECK(!document.gotoVersion(first + 1));
+        CHECK(!document.gotoVersion(first));
+        CHECK(document.getStrings() == std::vector<std::string>({"acd"}));
+        CHECK(document.gotoVersion(first + 2));
+        CHECK(document.getStrings() == std::vector<std::string>({"ac"}));
+    }
+
+    // Random edits and moves under a small limit: the tree stays connected, every live version
+    // keeps its own text, and every new version gets a new id.
+    template <typename Store>
+    void testPruneRandom() {
+        const size_t limit = 20;
+        std::mt19937 random(47);
+        Store store;
+        store.assign(std::vector<std::string>({"root"}));
+        UndoTree<Store> tree(store.snapshot());
+        tree.setHotVersions(4);
+        tree.setVersionLimit(limit);
+        std::vector<std::vector<std::string>> expected(1, contents(store));
+        bool intact = true;
+        bool fresh = true;
+        for (int step = 0; step < 5000; step++) {
+            if (random() % 3 != 0) {
+                store.assign(std::vector<std::string>({"step " + std::to_string(step), std::to_string(random())}));
+                size_t next = tree.nextVersionId();
+                tree.push(store);
+                fresh = fresh && tree.current() == next && tree.nextVersionId() == next + 1;
+                expected.resize(tree.nextVersionId());
+                expected[tree.current()] = contents(store);
+            } else {
+                size_t target = random() % tree.nextVersionId();
+                if (tree.isLive(target)) {
+                    tree.restore(target, store);
+                    intact = intact && contents(store) == expected[target];
+                }
+            }
+        }
+        CHECK(intact);
+        CHECK(fresh);
+        CHECK(tree.liveCount() <= limit);
+        bool connected = true;
+        for (size_t id = 0; id < tree.nextVersionId(); id++) {
+            if (!tree.isLive(id)) {
+                continue;
+            }
+            size_t steps = 0;
+            size_t ancestor = id;
+            while (tree.parent(ancestor) != UndoTree<Store>::kNoVersion && steps++ <= limit) {
+                ancestor = tree.parent(ancestor);
+            }
+            connected = connected && ancestor == tree.root();
+            for (size_t child : tree.children(id)) {
+                connected = connected && tree.isLive(child) && tree.parent(child) == id;
+            }
+        }
+        CHECK(connected);
+    }
+}
+
+int main() {
+    testLoadThenEdit<VectorLineStore>();
+    testLoadThenEdit<CompactLineStore>();
+    testLoadThenEdit<InternedLineStore>();
+    testLoadThenEdit<PagedLineStore>();
+    testReplaceThenEdit<VectorLineStore>();
+    testReplaceThenEdit<PagedLineStore>();
+    testPruneOrder<VectorLineStore>();
+    testPruneOrder<PagedLineStore>();
+    testGotoDropped<VectorLineStore>();
+    testPruneRandom<VectorLineStore>();
+    testPruneRandom<InternedLineStore>();
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "ConsoleMute.h"
+#include "StringArray.h"
+
+// Bulk line insertion: lines from a vector or a stream go in as one edit and one undo step.
+
+namespace {
+    std::vector<std::string> numbered(const std::string& prefix, size_t count) {
+        std::vector<std::string> lines;
+        for (size_t i = 0; i < count; i++) {
+            lines.push_back(prefix + std::to_string(i));
+        }
+        return lines;
+    }
+
+    // The offset index after the insert agrees with one built from scratch.
+    template <typename Store>
+    bool sameOffsets(const BasicStringArray<Store>& document) {
+        BasicStringArray<Store> fresh;
+        fresh.setStrings(document.getStrings());
+        int lines = static_cast<int>(document.getStringCount());
+        for (int line = 1; line <= lines; line += 1 + lines / 50) {
+            uint64_t expected, actual;
+            if (!fresh.positionToOffset(line, 0, expected) || !document.positionToOffset(line, 0, actual) ||
+                expected != actual) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename Store>
+    void testInsertLines() {
+        ConsoleMute mute;
+        BasicStringArray<Store> document;
+        std::vector<std::string> expected = numbered("line ", 5);
+        document.appendLines(expected);
+        CHECK(document.getStrings() == expected);
+
+        std::vector<std::string> middle = {"", "inserted", ""};
+        document.insertLines(3, middle);
+        expected.insert(expected.begin() + 2, middle.begin(), middle.end());
+        CHECK(document.getStrings() == expected);
+        document.insertLines(1, std::vector<std::string>({"first"}));
+        expected.insert(expected.begin(), "first");
+        CHECK(document.getStrings() == expected);
+        CHECK(sameOffsets(document));
+
+        // Each insert is one undo step.
+        document.undo();
+        expected.erase(expected.begin());
+        CHECK(document.getStrings() == expected);
+        document.undo();
+        expected.erase(expected.begin() + 2, expected.begin() + 5);
+        CHECK(document.getStrings() == expected);
+
+        // Out of range inserts change nothing.
+        document.insertLines(0, middle);
+        document.insertLines(static_cast<int>(document.getStringCount()) + 2, middle);
+        CHECK(document.getStrings() == expected);
+    }
+
+    // A stream longer than one batch, into the middle and at the end.
+    template <typename Store>
+    void testInsertStream() {
+        ConsoleMute mute;
+        BasicStringArray<Store> document;
+        std::vector<std::string> expected = numbered("kept ", 3);
+        document.appendLines(expected);
+
+        std::vector<std::string> streamed = numbered("streamed ", 64 * 1024 + 7);
+        std::string text;
+        for (const std::string& line : streamed) {
+            text += line + "\n";
+        }
+        std::istringstream in(text);
+        CHECK(document.insertLines(2, in) == streamed.size());
+        expected.insert(expected.begin() + 1, streamed.begin(), streamed.end());
+        CHECK(document.getStrings() == expected);
+        CHECK(sameOffsets(document));
+
+        std::istringstream tail("a\nb");
+        CHECK(document.appendLines(tail) == 2);
+        expected.push_back("a");
+        expected.push_back("b");
+        CHECK(document.getStrings() == expected);
+        CHECK(sameOffsets(document));
+
+        document.undo();
+        document.undo();
+        CHECK(document.getStrings() == numbered("kept ", 3));
+    }
+}
+
+int main() {
+    testInsertLines<VectorLineStore>();
+    testInsertLines<CompactLineStore>();
+    testInsertLines<InternedLineStore>();
+    testInsertLines<PagedLineStore>();
+    testInsertStream<VectorLineStore>();
+    testInsertStream<PagedLineStore>();
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,474 @@
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "ConsoleMute.h"
+#include "EditJournal.h"
+#include "StringArray.h"
+
+// Edit journal: the record format, and recovering a crashed session by loading its file again.
+
+namespace {
+    const char* const kDocument = "journal_test.txt";
+
+    EditCommand command(int number, std::vector<int64_t> numbers = std::vector<int64_t>(), const std::string& text = "") {
+        EditCommand request(number);
+        request.numbers = numbers;
+        request.text = text;
+        return request;
+    }
+
+    std::string documentText(const std::vector<std::string>& lines) {
+        std::string text;
+        for (const std::string& line : lines) {
+            text += line;
+            text.push_back('\n');
+        }
+        return text;
+    }
+
+    // An editor session the way runEditor drives one, recovering without asking. Destroying it
+    // without calling quit() is a crash: the journal stays behind.
+    template <typename Store>
+    class Session {
+    public:
+        BasicStringArray<Store> document;
+        EditJournal journal;
+
+        explicit Session(const SessionSettings& settings = SessionSettings()) : journal(settings) {
+            applySettings(document, settings);
+        }
+
+        bool run(const EditCommand& request) {
+            ConsoleMute mute;
+            bool ok = executeCommand(document, request);
+            if (request.command == 5 && ok) {
+                SessionSettings recoveredSettings;
+                std::vector<EditCommand> recovered =
+                    journal.attach(request.text, journalCheckpoint(document, false), recoveredSettings);
+                recoverJournal(journal, document, recovered, recoveredSettings);
+            } else if (request.command == 5) {
+                journal.discard();
+            } else {
+                journalCommand(journal, document, request, ok);
+            }
+            return ok;
+        }
+
+        void quit() {
+            journal.discard();
+        }
+    };
+
+    void testRecordFormat() {
+        std::string path = EditJournal::pathFor(kDocument);
+        std::remove(path.c_str());
+        SessionSettings written;
+        written.coalesceGap = std::chrono::milliseconds(250);
+        written.historyLimit = 12;
+        written.codepointColumns = true;
+        {
+            EditJournal journal(written);
+            EditCommand start = command(EditJournal::kCheckpoint, {0}, std::string("\0", 1));
+            SessionSettings recoveredSettings;
+            CHECK(journal.attach(kDocument, start, recoveredSettings).empty());
+            journal.append(command(1, {}, "text with\nnewline"));
+            journal.append(command(8, {1, -2, 300000}));
+        }
+        uint64_t validBytes;
+        SessionSettings settings;
+        std::vector<EditCommand> records = EditJournal::readRecords(path, validBytes, settings);
+        CHECK(settings.coalesceGap == written.coalesceGap && settings.historyLimit == written.historyLimit &&
+              settings.codepointColumns);
+        CHECK(records.size() == 3);
+        CHECK(validBytes == readTestFile(path).size());
+        if (records.size() == 3) {
+            CHECK(EditJournal::isCheckpoint(records[0]) && !EditJournal::checkpointHasDocument(records[0]));
+            CHECK(records[1].command == 1 && records[1].text == "text with\nnewline");
+            CHECK(records[2].command == 8 && records[2].numbers == std::vector<int64_t>({1, -2, 300000}));
+        }
+        CHECK(EditJournal::hasEdits(records));
+
+        // A record torn by a crash mid-write is dropped with everything after it.
+        std::string contents = readTestFile(path);
+        writeTestFile(path, contents.substr(0, contents.size() - 3));
+        records = EditJournal::readRecords(path, validBytes, settings);
+        CHECK(records.size() == 2);
+        contents[contents.size() - 2] ^= 0x55;
+        writeTestFile(path, contents);
+        CHECK(EditJournal::readRecords(path, validBytes, settings).size() == 2);
+
+        // Without the leading checkpoint there is nothing to recover.
+        writeTestFile(path, contents.substr(0, 8));
+        CHECK(EditJournal::readRecords(path, validBytes, settings).empty());
+        CHECK(validBytes == 0);
+        std::remove(path.c_str());
+    }
+
+    // Recovery must give the document the crashed session had, even after moves through the
+    // undo history, which the recovering process does not have.
+    template <typename Store>
+    void testRecoverHistoryMoves() {
+        std::string path = EditJournal::pathFor(kDocument);
+        std::remove(path.c_str());
+        writeTestFile(kDocument, "b\n");
+        std::vector<std::string> expected;
+        {
+            Session<Store> session;
+            session.run(command(1, {}, "Z"));
+            session.run(command(5, {}, kDocument));
+            session.run(command(1, {}, "X"));
+            size_t afterX = session.document.currentVersion();
+            session.run(command(1, {}, "Y"));
+            session.run(command(33, {static_cast<int64_t>(afterX)}));
+            CHECK(documentText(session.document.getStrings()) == "bX\n");
+            session.run(command(12, {1, 1, 1}));
+            session.run(command(1, {}, "W"));
+            session.run(command(9));
+            session.run(command(10));
+            session.run(command(9));
+            session.run(command(13, {1, 0}));
+            expected = session.document.getStrings();
+        }
+        CHECK(documentText(expected) == "XbX\n");
+        {
+            Session<Store> session;
+            session.run(command(5, {}, kDocument));
+            CHECK(session.document.getStrings() == expected);
+        }
+        std::remove(path.c_str());
+        std::remove(kDocument);
+    }
+
+    // Undo, redo and goto are small records, not checkpoints holding the document, unless they
+    // go back past the checkpoint the journal started from.
+    void testHistoryMoveRecords() {
+        std::string path = EditJournal::pathFor(kDocument);
+        std::remove(path.c_str());
+        std::string text;
+        for (int line = 0; line < 1000; line++) {
+            text += "line " + std::to_string(line) + "\n";
+        }
+        writeTestFile(kDocument, text);
+        std::vector<std::string> expected;
+        {
+            Session<VectorLineStore> session;
+            session.run(command(1, {}, "before"));
+            session.run(command(5, {}, kDocument));
+            session.run(command(1, {}, "X"));
+            size_t afterX = session.document.currentVersion();
+            session.run(command(1, {}, "Y"));
+            session.run(command(9));
+            session.run(command(10));
+            session.run(command(33, {static_cast<int64_t>(afterX)}));
+            session.run(command(9));
+            session.run(command(10));
+            session.run(command(1, {}, "Z"));
+            expected = session.document.getStrings();
+        }
+        uint64_t validBytes;
+        SessionSettings settings;
+        std::vector<EditCommand> records = EditJournal::readRecords(path, validBytes, settings);
+        size_t checkpoints = 0;
+        for (const EditCommand& record : records) {
+            checkpoints += EditJournal::isCheckpoint(record) ? 1 : 0;
+        }
+        CHECK(checkpoints == 1 && !EditJournal::checkpointHasDocument(records[0]));
+        CHECK(validBytes < text.size() / 10);
+        {
+            Session<VectorLineStore> session;
+            session.run(command(5, {}, kDocument));
+            CHECK(session.document.getStrings() == expected);
+            // Back past the load, which the journal cannot rebuild.
+            session.run(command(9));
+            session.run(command(9));
+            session.run(command(9));
+            expected = session.document.getStrings();
+        }
+        CHECK(expected == std::vector<std::string>());
+        records = EditJournal::readRecords(path, validBytes, settings);
+        CHECK(!records.empty() && EditJournal::checkpointHasDocument(records[0]));
+        {
+            Session<VectorLineStore> session;
+            session.run(command(5, {}, kDocument));
+            CHECK(session.document.getStrings() == expected);
+            session.quit();
+        }
+        std::remove(kDocument);
+    }
+
+    // A transaction opened right after a load adds the loaded document as a version of its own,
+    // made from the version before the load, which the journal still cannot rebuild.
+    void testTransactionAfterLoad() {
+        std::string path = EditJournal::pathFor(kDocument);
+        std::remove(path.c_str());
+        writeTestFile(kDocument, "b\n");
+        std::vector<std::string> expected;
+        {
+            Session<VectorLineStore> session;
+            session.run(command(1, {}, "before"));
+            size_t before = session.document.currentVersion();
+            session.run(command(5, {}, kDocument));
+            session.run(command(28));
+            session.run(command(1, {}, "t"));
+            session.run(command(29));
+            session.run(command(33, {static_cast<int64_t>(before)}));
+            expected = session.document.getStrings();
+        }
+        CHECK(expected == std::vector<std::string>({"before"}));
+        {
+            Session<VectorLineStore> session;
+            session.run(command(5, {}, kDocument));
+            CHECK(session.document.getStrings() == expected);
+            session.quit();
+        }
+        std::remove(kDocument);
+    }
+
+    // Random edits, transactions, saves and moves through the history, typing coalesced and
+    // versions dropped by a limit: recovery gives the document the crashed session had.
+    void testRecoverRandomMoves() {
+        std::string path = EditJournal::pathFor(kDocument);
+        std::mt19937 random(36);
+        bool recovered = true;
+        for (int round = 0; round < 40; round++) {
+            std::remove(path.c_str());
+            writeTestFile(kDocument, "a\nb\n");
+            SessionSettings settings;
+            settings.coalesceGap = std::chrono::milliseconds(60000);
+            settings.historyLimit = round % 2 == 0 ? 0 : 6;
+            std::vector<std::string> expected;
+            {
+                Session<VectorLineStore> session(settings);
+                session.run(command(1, {}, "before"));
+                session.run(command(5, {}, kDocument));
+                for (int step = 0; step < 80; step++) {
+                    int lines = static_cast<int>(session.document.getStringCount());
+                    int line = lines == 0 ? 1 : 1 + static_cast<int>(random() % lines);
+                    switch (random() % 10) {
+                        case 0:
+                        case 1:
+                            session.run(command(1, {}, std::string(1, static_cast<char>('a' + random() % 26))));
+                            break;
+                        case 2:
+                            session.run(command(7, {line, 0, 0}, "i"));
+                            break;
+                        case 3:
+                            session.run(command(8, {line, 0, 1}));
+                            break;
+                        case 4:
+                            session.run(command(2));
+                            break;
+                        case 5:
+                            session.run(command(9));
+                            break;
+                        case 6:
+                            session.run(command(10));
+                            break;
+                        case 7:
+                            session.run(command(33, {static_cast<int64_t>(random() % session.document.nextVersionId())}));
+                            break;
+                        case 8:
+                            session.run(command(28));
+                            session.run(command(1, {}, "t"));
+                            session.run(command(2));
+                            session.run(command(random() % 2 == 0 ? 29 : 30));
+                            break;
+                        default:
+                            if (random() % 4 == 0) {
+                                session.run(command(4, {}, kDocument));
+                            } else {
+                                session.run(command(random() % 2 == 0 ? 9 : 10));
+                            }
+                            break;
+                    }
+                }
+                expected = session.document.getStrings();
+            }
+            {
+                Session<VectorLineStore> session(settings);
+                session.run(command(5, {}, kDocument));
+                recovered = recovered && session.document.getStrings() == expected;
+                session.quit();
+            }
+        }
+        CHECK(recovered);
+        std::remove(kDocument);
+    }
+
+    // The clipboard a session had when it loaded the file is part of the journal, so pasting it
+    // is recovered too.
+    void testRecoverClipboard() {
+        std::string path = EditJournal::pathFor(kDocument);
+        std::remove(path.c_str());
+        writeTestFile(kDocument, "b\n");
+        {
+            Session<VectorLineStore> session;
+            session.run(command(1, {}, "copied"));
+            session.run(command(12, {1, 0, 6}));
+            session.run(command(5, {}, kDocument));
+            session.run(command(13, {1, 1}));
+            CHECK(documentText(session.document.getStrings()) == "bcopied\n");
+        }
+        {
+            Session<VectorLineStore> session;
+            session.run(command(5, {}, kDocument));
+            CHECK(documentText(session.document.getStrings()) == "bcopied\n");
+        }
+        std::remove(path.c_str());
+        std::remove(kDocument);
+    }
+
+    // A load that fails neither attaches the journal nor replays one left for that name.
+    void testFailedLoad() {
+        std::string path = EditJournal::pathFor(kDocument);
+        std::remove(path.c_str());
+        writeTestFile(kDocument, "b\n");
+        {
+            Session<VectorLineStore> session;
+            session.run(command(5, {}, kDocument));
+            session.run(command(1, {}, "X"));
+        }
+        std::remove(kDocument);
+        {
+            Session<VectorLineStore> session;
+            CHECK(!session.run(command(5, {}, kDocument)));
+            CHECK(!session.journal.isAttached());
+            CHECK(session.document.getStringCount() == 0);
+            session.run(command(1, {}, "Y"));
+        }
+        // The checkpoint, the edit and the version it made.
+        uint64_t validBytes;
+        SessionSettings settings;
+        CHECK(EditJournal::readRecords(path, validBytes, settings).size() == 3);
+        std::remove(path.c_str());
+    }
+
+    // Recovery replays with the columns the journal was written with and without coalescing,
+    // whatever the recovering session uses, then goes back to the session's own settings.
+    void testRecoverUnderOtherSettings() {
+        std::string path = EditJournal::pathFor(kDocument);
+        std::remove(path.c_str());
+        writeTestFile(kDocument, "\xC3\xA9t\xC3\xA9\n");
+        SessionSettings coalescing;
+        coalescing.coalesceGap = std::chrono::milliseconds(40);
+        SessionSettings codepoints;
+        codepoints.codepointColumns = true;
+        std::vector<std::string> expected;
+        {
+            // Two appends far enough apart not to coalesce, then an undo of the second.
+            Session<VectorLineStore> session(coalescing);
+            session.run(command(5, {}, kDocument));
+            session.run(command(1, {}, "a"));
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            session.run(command(1, {}, "b"));
+            session.run(command(9));
+            session.run(command(1, {}, "c"));
+            session.run(command(1, {}, "d"));
+            expected = session.document.getStrings();
+        }
+        CHECK(documentText(expected) == "\xC3\xA9t\xC3\xA9" "acd\n");
+        {
+            Session<VectorLineStore> session(coalescing);
+            session.run(command(5, {}, kDocument));
+            CHECK(session.document.getStrings() == expected);
+            // Replayed edits are separate undo steps.
+            session.run(command(9));
+            CHECK(documentText(session.document.getStrings()) == "\xC3\xA9t\xC3\xA9" "ac\n");
+        }
+        std::remove(path.c_str());
+        {
+            // Positions in codepoints: insert before the second character.
+            Session<VectorLineStore> session(codepoints);
+            session.run(command(5, {}, kDocument));
+            session.run(command(7, {1, 1, 0}, "-"));
+            expected = session.document.getStrings();
+        }
+        CHECK(documentText(expected) == "\xC3\xA9-t\xC3\xA9\n");
+        {
+            Session<VectorLineStore> session;
+            session.run(command(5, {}, kDocument));
+            CHECK(session.document.getStrings() == expected);
+            CHECK(!session.document.usesCodepointColumns());
+            session.run(command(7, {1, 2, 0}, "+"));
+            expected = session.document.getStrings();
+        }
+        CHECK(documentText(expected) == "\xC3\xA9+-t\xC3\xA9\n");
+        {
+            // The journal restarted in bytes after the recovery above.
+            Session<VectorLineStore> session;
+            session.run(command(5, {}, kDocument));
+            CHECK(session.document.getStrings() == expected);
+            session.quit();
+        }
+        std::remove(kDocument);
+    }
+
+    bool fileExists(const std::string& fileName) {
+        std::ifstream file(fileName);
+        return file.is_open();
+    }
+
+    // Edits that were given up leave no journal behind to be replayed later.
+    void testDiscardedEdits() {
+        const char* const other = "journal_test_other.txt";
+        std::string path = EditJournal::pathFor(kDocument);
+        writeTestFile(kDocument, "b\n");
+        writeTestFile(other, "c\n");
+        {
+            // Quitting.
+            Session<VectorLineStore> session;
+            session.run(command(5, {}, kDocument));
+            session.run(command(1, {}, "X"));
+            session.quit();
+        }
+        CHECK(!fileExists(path));
+        {
+            // Loading another file, or the same one again.
+            Session<VectorLineStore> session;
+            session.run(command(5, {}, kDocument));
+            session.run(command(1, {}, "X"));
+            session.run(command(5, {}, other));
+            CHECK(!fileExists(path));
+            session.run(command(1, {}, "Y"));
+            session.run(command(5, {}, other));
+            CHECK(documentText(session.document.getStrings()) == "c\n");
+            session.quit();
+        }
+        CHECK(!fileExists(EditJournal::pathFor(other)));
+        {
+            // Restoring a session.
+            Session<VectorLineStore> session;
+            session.run(command(1, {}, "S"));
+            session.run(command(21, {}, "journal_test.session"));
+            session.run(command(5, {}, kDocument));
+            session.run(command(1, {}, "X"));
+            session.run(command(22, {}, "journal_test.session"));
+            CHECK(!session.journal.isAttached());
+        }
+        CHECK(!fileExists(path));
+        std::remove("journal_test.session");
+        std::remove(other);
+        std::remove(kDocument);
+    }
+}
+
+int main() {
+    testRecordFormat();
+    testRecoverHistoryMoves<VectorLineStore>();
+    testRecoverHistoryMoves<CompactLineStore>();
+    testRecoverHistoryMoves<InternedLineStore>();
+    testRecoverHistoryMoves<PagedLineStore>();
+    testHistoryMoveRecords();
+    testTransactionAfterLoad();
+    testRecoverRandomMoves();
+    testRecoverClipboard();
+    testFailedLoad();
+    testDiscardedEdits();
+    testRecoverUnderOtherSettings();
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "LzCodec.h"
+#include "PackedLines.h"
+
+// LZ codec and packed documents: everything compressed comes back byte for byte, and damaged
+// streams are rejected without reading or writing out of bounds.
+
+namespace {
+    bool roundTrips(const std::string& raw) {
+        std::string packed, unpacked;
+        LzCodec::compress(raw.data(), raw.size(), packed);
+        return LzCodec::decompress(packed.data(), packed.size(), unpacked) && unpacked == raw;
+    }
+
+    std::string randomBytes(std::mt19937& random, size_t size) {
+        std::string bytes(size, '\0');
+        for (char& byte : bytes) {
+            byte = static_cast<char>(random() & 0xFF);
+        }
+        return bytes;
+    }
+
+    std::string prose(size_t size) {
+        static const char* const words[] = {"the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ",
+                                            "dog ", "and ", "keeps ", "running\n"};
+        std::string text;
+        for (size_t i = 0; text.size() < size; i++) {
+            text += words[(i * 7 + i / 3) % 11];
+        }
+        text.resize(size);
+        return text;
+    }
+
+    void testRoundTrips() {
+        std::mt19937 random(42);
+        CHECK(roundTrips(""));
+        CHECK(roundTrips("a"));
+        CHECK(roundTrips("abc"));
+        CHECK(roundTrips("abcd"));
+        // Runs: matches that overlap the bytes they produce.
+        CHECK(roundTrips(std::string(1, 'x') + std::string(100000, 'y')));
+        CHECK(roundTrips(std::string(15 + 255 * 3, 'z')));
+        // Literal and match lengths right at the token and extension-byte boundaries.
+        for (size_t length : {14, 15, 16, 269, 270, 271, 524, 525}) {
+            std::string literals = randomBytes(random, length);
+            CHECK(roundTrips(literals));
+            CHECK(roundTrips(literals + literals + randomBytes(random, 3)));
+        }
+        std::string allBytes;
+        for (int byte = 0; byte < 256; byte++) {
+            allBytes.push_back(static_cast<char>(byte));
+        }
+        CHECK(roundTrips(allBytes + allBytes));
+        CHECK(roundTrips(randomBytes(random, 200000)));
+        // A repeat further back than the 64KB window.
+        std::string block = randomBytes(random, 70000);
+        CHECK(roundTrips(block + block));
+        CHECK(roundTrips(prose(1 << 20)));
+    }
+
+    void testCompressesText() {
+        std::string text = prose(1 << 20);
+        std::string packed;
+        LzCodec::compress(text.data(), text.size(), packed);
+        CHECK(packed.size() * 2 < text.size());
+    }
+
+    void testRejectsDamagedStreams() {
+        std::mt19937 random(7);
+        std::string text = prose(5000) + randomBytes(random, 500);
+        std::string packed, unpacked;
+        LzCodec::compress(text.data(), text.size(), packed);
+        for (size_t length = 0; length < packed.size(); length++) {
+            CHECK(!LzCodec::decompress(packed.data(), length, unpacked));
+        }
+        // Random corruption must fail cleanly or decode to something; the sanitizers check bounds.
+        for (int round = 0; round < 2000; round++) {
+            std::string damaged = packed;
+            for (int flips = 0; flips < 3; flips++) {
+                damaged[random() % damaged.size()] ^= static_cast<char>(1 << (random() % 8));
+            }
+            LzCodec::decompress(damaged.data(), damaged.size(), unpacked);
+        }
+        for (int round = 0; round < 2000; round++) {
+            std::string noise = randomBytes(random, random() % 64);
+            LzCodec::decompress(noise.data(), noise.size(), unpacked);
+        }
+    }
+
+    void testPackedLines() {
+        std::vector<std::string> lines = {"", "one", "", std::string(300, 'x'), "last line"};
+        LineViewList views;
+        for (const std::string& line : lines) {
+            views.views.push_back(LineView(line.data(), line.size()));
+        }
+        PackedLines packed;
+        packed.pack(views);
+        LineViewList unpacked;
+        CHECK(packed.unpack(unpacked));
+        CHECK(unpacked.size() == lines.size());
+        for (size_t i = 0; i < lines.size() && i < unpacked.size(); i++) {
+            CHECK(std::string(unpacked.line(i).data, unpacked.line(i).size) == lines[i]);
+        }
+
+        PackedLines copy;
+        copy.assign(packed.bytes().data(), packed.bytes().size() - 1);
+        CHECK(!copy.unpack(unpacked));
+
+        LineViewList none;
+        packed.pack(none);
+        CHECK(packed.unpack(unpacked));
+        CHECK(unpacked.size() == 0);
+    }
+}
+
+int main() {
+    testRoundTrips();
+    testCompressesText();
+    testRejectsDamagedStreams();
+    testPackedLines();
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "ConsoleMute.h"
+#include "StringArray.h"
+
+// Incremental saves: only the edited part of a file the document was loaded from is written,
+// unless the file changed on disk since.
+
+namespace {
+    const char* const kDocument = "save_test.txt";
+
+    void testPatchesUnchangedFile() {
+        ConsoleMute mute;
+        writeTestFile(kDocument, "one\ntwo\nthree\n");
+        BasicStringArray<VectorLineStore> document;
+        CHECK(document.loadFromFile(kDocument));
+        document.insertSubstring(2, 0, "T", true);
+        CHECK(document.saveToFile(kDocument));
+        CHECK(readTestFile(kDocument) == "one\nTwo\nthree\n");
+        document.insertSubstring(3, 5, "!", false);
+        CHECK(document.saveToFile(kDocument));
+        CHECK(readTestFile(kDocument) == "one\nTwo\nthree!\n");
+        std::remove(kDocument);
+    }
+
+    // A file rewritten in place or replaced with one of the same size must not be patched:
+    // the lines the editor did not touch are no longer what the document holds.
+    void testRewritesChangedFile() {
+        ConsoleMute mute;
+        writeTestFile(kDocument, "one\ntwo\nthree\n");
+        BasicStringArray<VectorLineStore> document;
+        CHECK(document.loadFromFile(kDocument));
+        document.insertSubstring(2, 0, "T", true);
+
+        // Past the file system's timestamp granularity.
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        writeTestFile(kDocument, "ONE\ntwo\nTHREE\n");
+        CHECK(document.saveToFile(kDocument));
+        CHECK(readTestFile(kDocument) == "one\nTwo\nthree\n");
+
+        document.insertSubstring(1, 0, "O", true);
+        std::string replacement = std::string(kDocument) + ".new";
+        writeTestFile(replacement, "one\nTWO\nthree\n");
+        std::remove(kDocument);
+        CHECK(std::rename(replacement.c_str(), kDocument) == 0);
+        CHECK(document.saveToFile(kDocument));
+        CHECK(readTestFile(kDocument) == "One\nTwo\nthree\n");
+        std::remove(kDocument);
+    }
+
+    // An empty line added after a last line that had no newline must still be in the file,
+    // whether the save patches the file or writes it whole.
+    void testEmptyLastLine() {
+        ConsoleMute mute;
+        const std::string copy = std::string(kDocument) + ".copy";
+        writeTestFile(kDocument, "abc");
+        BasicStringArray<VectorLineStore> document;
+        CHECK(document.loadFromFile(kDocument));
+        document.addEmptyLine();
+        CHECK(document.saveToFile(kDocument));
+        CHECK(readTestFile(kDocument) == "abc\n\n");
+        CHECK(document.saveToFile(copy));
+        CHECK(readTestFile(copy) == "abc\n\n");
+        CHECK(document.saveToFile(kDocument));
+        BasicStringArray<VectorLineStore> reloaded;
+        CHECK(reloaded.loadFromFile(kDocument));
+        CHECK(reloaded.getStrings() == std::vector<std::string>({"abc", ""}));
+
+        // Once the line has text it is saved without a newline again, as the file was.
+        document.insertSubstring(2, 0, "d");
+        CHECK(document.saveToFile(kDocument));
+        CHECK(readTestFile(kDocument) == "abc\nd");
+        document.deleteSubstring(2, 0, 1);
+        CHECK(document.saveToFile(kDocument));
+        CHECK(readTestFile(kDocument) == "abc\n\n");
+        std::remove(kDocument);
+        std::remove(copy.c_str());
+    }
+}
+
+int main() {
+    testPatchesUnchangedFile();
+    testRewritesChangedFile();
+    testEmptyLastLine();
+    return checkFailures() == 0 ? 0 : 1;
+}
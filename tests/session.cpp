@@ -0,0 +1,162 @@
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "ConsoleMute.h"
+#include "StringArray.h"
+
+// Session files: a saved session restores the document, the whole undo tree, the clipboard and
+// the format the document saves in.
+
+namespace {
+    const char* const kSession = "session_test.session";
+    const char* const kText = "session_test.txt";
+
+    // The version table without the state column: which versions are packed depends on how
+    // they were reached, not on the tree.
+    template <typename Store>
+    std::string versions(const BasicStringArray<Store>& document) {
+        std::ostringstream out;
+        document.printVersions(out);
+        std::istringstream table(out.str());
+        std::string tree, line;
+        while (std::getline(table, line)) {
+            std::istringstream columns(line);
+            std::string version, parent, children;
+            columns >> version >> parent >> children;
+            tree += version + " " + parent + " " + children + "\n";
+        }
+        return tree;
+    }
+
+    template <typename Store>
+    std::string clipboard(const BasicStringArray<Store>& document) {
+        std::ostringstream out;
+        document.printClipboard(out);
+        return out.str();
+    }
+
+    // Undoes, then redoes, both documents step by step, checking that they stay equal.
+    template <typename Store>
+    void checkSameHistory(BasicStringArray<Store>& original, BasicStringArray<Store>& restored) {
+        for (int step = 0; step < 20; step++) {
+            original.undo();
+            restored.undo();
+            CHECK(original.getStrings() == restored.getStrings());
+        }
+        for (int step = 0; step < 20; step++) {
+            original.redo();
+            restored.redo();
+            CHECK(original.getStrings() == restored.getStrings());
+        }
+    }
+
+    // A history with a branch, versions old enough to be packed, a clipboard, and a document
+    // that is detached from the tree.
+    template <typename Store>
+    void buildSession(BasicStringArray<Store>& document) {
+        document.setHotHistory(2);
+        document.addString("first line");
+        document.addEmptyLine();
+        document.addString("second line");
+        document.addEmptyLine();
+        document.addString("first line");
+        document.insertSubstring(2, 0, ">> ");
+        document.copy(1, 0, 5);
+        document.cut(3, 0, 5);
+        document.undo();
+        document.undo();
+        document.addEmptyLine();
+        document.addString("branch");
+        document.paste(4, 0);
+        document.deleteSubstring(1, 0, 1);
+        document.undo();
+    }
+
+    template <typename Store>
+    void testRoundTrip() {
+        ConsoleMute mute;
+        BasicStringArray<Store> original;
+        buildSession(original);
+        CHECK(original.saveSession(kSession));
+
+        BasicStringArray<Store> restored;
+        restored.setHotHistory(2);
+        CHECK(restored.loadSession(kSession));
+        CHECK(restored.getStrings() == original.getStrings());
+        CHECK(versions(restored) == versions(original));
+        CHECK(clipboard(restored) == clipboard(original));
+        checkSameHistory(original, restored);
+
+        // A detached document comes back detached: undo first returns to the current version.
+        std::vector<std::string> replaced = {"replaced", "document"};
+        original.setStrings(replaced);
+        CHECK(original.saveSession(kSession));
+        BasicStringArray<Store> detached;
+        CHECK(detached.loadSession(kSession));
+        CHECK(detached.getStrings() == replaced);
+        checkSameHistory(original, detached);
+        std::remove(kSession);
+    }
+
+    // A document restored from a session saves in the encoding, line ending, byte order mark and
+    // final newline of the file it was loaded from.
+    void checkFileFormat(const std::string& contents) {
+        ConsoleMute mute;
+        writeTestFile(kText, contents);
+        BasicStringArray<VectorLineStore> original;
+        CHECK(original.loadFromFile(kText));
+        CHECK(original.saveSession(kSession));
+        std::remove(kText);
+
+        BasicStringArray<VectorLineStore> restored;
+        CHECK(restored.loadSession(kSession));
+        CHECK(restored.getTextFormat().describe() == original.getTextFormat().describe());
+        CHECK(restored.saveToFile(kText));
+        CHECK(readTestFile(kText) == contents);
+        std::remove(kText);
+        std::remove(kSession);
+    }
+
+    void testFileFormat() {
+        checkFileFormat("\xEF\xBB\xBFone\r\ntwo");
+        checkFileFormat("one\rtwo\r");
+        checkFileFormat(std::string("\xFF\xFEh\0i\0\r\0\n\0\xE9\0", 12));
+        checkFileFormat(std::string("\xFE\xFF\0h\0i\0\n", 8));
+        checkFileFormat("caf\xE9\n");
+    }
+
+    // A damaged session is refused and leaves the document as it was.
+    void testDamagedSession() {
+        ConsoleMute mute;
+        BasicStringArray<VectorLineStore> original;
+        buildSession(original);
+        CHECK(original.saveSession(kSession));
+        std::string contents = readTestFile(kSession);
+
+        BasicStringArray<VectorLineStore> target;
+        target.addString("untouched");
+        std::string damaged = contents;
+        damaged[damaged.size() / 2] ^= 0x20;
+        writeTestFile(kSession, damaged);
+        CHECK(!target.loadSession(kSession));
+        writeTestFile(kSession, contents.substr(0, contents.size() - 1));
+        CHECK(!target.loadSession(kSession));
+        writeTestFile(kSession, contents.substr(0, 40));
+        CHECK(!target.loadSession(kSession));
+        CHECK(target.getStrings() == std::vector<std::string>({"untouched"}));
+        std::remove(kSession);
+    }
+}
+
+int main() {
+    testRoundTrip<VectorLineStore>();
+    testRoundTrip<CompactLineStore>();
+    testRoundTrip<InternedLineStore>();
+    testRoundTrip<PagedLineStore>();
+    testFileFormat();
+    testDamagedSession();
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ChromeTrace.h"
+#include "ConsoleMute.h"
+#include "EditTrace.h"
+#include "EditorCommands.h"
+#include "StringArray.h"
+
+// Replays a trace recorded with `Hm2PP --record=<file>` against a StringArray at full speed and
+// reports latency percentiles per command, next to the latencies seen while recording. The
+// document gets the settings the session was recorded with, and edits coalesce by their
+// recorded times. Files the session loaded or saved are replayed from copies in a scratch
+// directory (by default "<trace>.scratch"), so the originals are never written.
+//
+// Usage: Hm2PP_replay <trace> [--store=vector|compact|interned|paged] [--repeat=N] [--scratch=<dir>]
+//                     [--chrome-trace=<file>]
+
+namespace {
+    struct Latencies {
+        std::vector<uint64_t> replayed;
+        std::vector<uint64_t> recorded;
+    };
+
+    uint64_t percentile(std::vector<uint64_t>& values, double fraction) {
+        if (values.empty()) {
+            return 0;
+        }
+        size_t rank = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+        std::nth_element(values.begin(), values.begin() + rank, values.end());
+        return values[rank];
+    }
+
+    void printRow(const std::string& name, std::vector<uint64_t>& values) {
+        std::cout << std::left << std::setw(24) << name << std::right << std::setw(8) << values.size();
+        const double fractions[] = {0.5, 0.9, 0.99, 0.999, 1.0};
+        for (double fraction : fractions) {
+            std::cout << std::setw(12) << percentile(values, fraction);
+        }
+        std::cout << std::endl;
+    }
+
+    bool copyFile(const std::string& from, const std::string& to) {
+        std::ifstream in(from, std::ios::binary);
+        if (!in.is_open()) {
+            return false;
+        }
+        std::ofstream out(to, std::ios::binary | std::ios::trunc);
+        if (in.peek() != std::ifstream::traits_type::eof()) {
+            out << in.rdbuf();
+        }
+        return static_cast<bool>(out);
+    }
+
+    // Keeps replay away from the files the recorded session used: saves would overwrite them,
+    // and with --repeat later rounds would load what earlier rounds wrote. Every file a command
+    // names is redirected into a scratch directory, and before each round the scratch copies are
+    // reset to the originals as they were when replay started.
+    class ScratchFiles {
+    private:
+        struct Entry {
+            std::string scratchPath;
+            std::string pristinePath;
+            bool existed;
+        };
+
+        std::string directory;
+        std::map<std::string, Entry> entries;
+
+    public:
+        explicit ScratchFiles(const std::string& directory) : directory(directory) {}
+
+        ScratchFiles(const ScratchFiles&) = delete;
+        ScratchFiles& operator=(const ScratchFiles&) = delete;
+
+        ~ScratchFiles() {
+            for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                std::remove(it->second.scratchPath.c_str());
+                std::remove(it->second.pristinePath.c_str());
+            }
+#if defined(_WIN32)
+            _rmdir(directory.c_str());
+#else
+            rmdir(directory.c_str());
+#endif
+        }
+
+        // Creates the directory, copies every file the records name into it and points the
+        // records at the copies.
+        bool prepare(std::vector<TraceRecord>& records) {
+#if defined(_WIN32)
+            bool created = _mkdir(directory.c_str()) == 0;
+#else
+            bool created = mkdir(directory.c_str(), 0755) == 0;
+#endif
+            if (!created && errno != EEXIST) {
+                return false;
+            }
+            for (TraceRecord& record : records) {
+                if (!commandNamesFile(record.request.command)) {
+                    continue;
+                }
+                std::map<std::string, Entry>::iterator it = entries.find(record.request.text);
+                if (it == entries.end()) {
+                    Entry entry;
+                    entry.scratchPath = directory + "/" + std::to_string(entries.size());
+                    entry.pristinePath = entry.scratchPath + ".orig";
+                    entry.existed = copyFile(record.request.text, entry.pristinePath);
+                    it = entries.insert(std::make_pair(record.request.text, entry)).first;
+                }
+                record.request.text = it->second.scratchPath;
+            }
+            return true;
+        }
+
+        // Puts every scratch file back the way the original was; files that did not exist are
+        // removed.
+        void reset() {
+            for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                if (it->second.existed) {
+                    copyFile(it->second.pristinePath, it->second.scratchPath);
+                } else {
+                    std::remove(it->second.scratchPath.c_str());
+                }
+            }
+        }
+    };
+
+    template <typename Store>
+    void replay(const std::vector<TraceRecord>& records, const SessionSettings& settings, ScratchFiles& scratch,
+                int repeat) {
+        std::map<std::string, Latencies> byCommand;
+        Latencies total;
+        std::chrono::steady_clock::time_point replayStart = std::chrono::steady_clock::now();
+
+        for (int round = 0; round < repeat; round++) {
+            scratch.reset();
+            BasicStringArray<Store> stringArray;
+            applySettings(stringArray, settings);
+            // Edits count as made at their recorded start, so coalescing sees the recorded gaps.
+            std::chrono::steady_clock::time_point editTime;
+            stringArray.setEditClock([&editTime]() { return editTime; });
+            ConsoleMute mute;
+            for (const TraceRecord& record : records) {
+                editTime = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(record.startNs));
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                executeCommand(stringArray, record.request);
+                std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+                uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+                if (ChromeTrace::enabled()) {
+                    ChromeTrace::complete(std::string("command ") + commandName(record.request.command), "command",
+                                          start, end);
+                }
+
+                Latencies& latencies = byCommand[commandName(record.request.command)];
+                latencies.replayed.push_back(elapsed);
+                total.replayed.push_back(elapsed);
+                if (round == 0) {
+                    latencies.recorded.push_back(record.durationNs);
+                    total.recorded.push_back(record.durationNs);
+                }
+            }
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+        std::cout << "Replayed " << total.replayed.size() << " commands in " << std::fixed << std::setprecision(3)
+                  << seconds << " s" << std::endl;
+        std::cout << std::left << std::setw(24) << "command (ns)" << std::right << std::setw(8) << "count"
+                  << std::setw(12) << "p50" << std::setw(12) << "p90" << std::setw(12) << "p99"
+                  << std::setw(12) << "p99.9" << std::setw(12) << "max" << std::endl;
+        for (std::map<std::string, Latencies>::iterator it = byCommand.begin(); it != byCommand.end(); ++it) {
+            printRow(it->first, it->second.replayed);
+            printRow(it->first + " (recorded)", it->second.recorded);
+        }
+        printRow("all", total.replayed);
+        printRow("all (recorded)", total.recorded);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string traceFile;
+    std::string store = "vector";
+    std::string scratchDirectory;
+    int repeat = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 8, "--store=") == 0) {
+            store = arg.substr(8);
+        } else if (arg.compare(0, 9, "--repeat=") == 0) {
+            repeat = std::max(1, std::atoi(arg.substr(9).c_str()));
+        } else if (arg.compare(0, 10, "--scratch=") == 0) {
+            scratchDirectory = arg.substr(10);
+        } else if (arg.compare(0, 15, "--chrome-trace=") == 0) {
+            if (!ChromeTrace::open(arg.substr(15))) {
+                std::cerr << "Error opening the Chrome trace file." << std::endl;
+                return 1;
+            }
+        } else {
+            traceFile = arg;
+        }
+    }
+
+    if (traceFile.empty()) {
+        std::cerr << "Usage: Hm2PP_replay <trace> [--store=vector|compact|interned|paged] [--repeat=N] "
+                     "[--scratch=<dir>] [--chrome-trace=<file>]" << std::endl;
+        return 1;
+    }
+
+    TraceReader reader(traceFile);
+    if (!reader.isValid()) {
+        std::cerr << "Error opening the trace file." << std::endl;
+        return 1;
+    }
+    std::vector<TraceRecord> records;
+    TraceRecord record;
+    while (reader.next(record)) {
+        records.push_back(record);
+    }
+
+    ScratchFiles scratch(scratchDirectory.empty() ? traceFile + ".scratch" : scratchDirectory);
+    if (!scratch.prepare(records)) {
+        std::cerr << "Error creating the scratch directory." << std::endl;
+        return 1;
+    }
+    const SessionSettings& settings = reader.settings();
+    std::cout << "Session settings: coalesce-ms=" << settings.coalesceGap.count()
+              << " history-limit=" << settings.historyLimit
+              << " columns=" << (settings.codepointColumns ? "codepoints" : "bytes") << std::endl;
+
+    if (store == "compact") {
+        replay<CompactLineStore>(records, settings, scratch, repeat);
+    } else if (store == "interned") {
+        replay<InternedLineStore>(records, settings, scratch, repeat);
+    } else if (store == "paged") {
+        replay<PagedLineStore>(records, settings, scratch, repeat);
+    } else if (store == "vector") {
+        replay<VectorLineStore>(records, settings, scratch, repeat);
+    } else {
+        std::cerr << "Unknown store: " << store << std::endl;
+        return 1;
+    }
+    ChromeTrace::close();
+    return 0;
+}